@@ -55,6 +55,13 @@ public:
 
     static void RunAll(const Args& args);
 };
+
+/**
+ * Replay a trace recorded with baddcoind -mempooltrace through a mempool,
+ * block assembly and the fee estimator, and print latency histograms of
+ * each. Returns false if the trace cannot be read.
+ */
+bool ReplayMempoolTrace(const std::string& path);
 }
 // BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo");
 #define BENCHMARK(n) \
@@ -21,6 +21,7 @@ static void SetupBenchArgs(ArgsManager& argsman)
     argsman.AddArg("-asymptote=n1,n2,n3,...", strprintf("Test asymptotic growth of the runtime of an algorithm, if supported by the benchmark"), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-output_csv=<output.csv>", "Generate CSV file with the most important benchmark results.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-output_json=<output.json>", "Generate JSON file with all benchmark results.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-mempooltrace=<file>", "Replay a mempool trace recorded with baddcoind -mempooltrace instead of running the benchmarks", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 }
 
 // parses a comma separated list like "10,20,30,50"
@@ -53,6 +54,10 @@ int main(int argc, char** argv)
         return EXIT_SUCCESS;
     }
 
+    if (argsman.IsArgSet("-mempooltrace")) {
+        return benchmark::ReplayMempoolTrace(argsman.GetArg("-mempooltrace", "")) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     benchmark::Args args;
     args.regex_filter = argsman.GetArg("-filter", DEFAULT_BENCH_FILTER);
     args.is_list_only = argsman.GetBoolArg("-list", false);
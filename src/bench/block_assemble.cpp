@@ -8,6 +8,7 @@
 #include <test/util/mining.h>
 #include <test/util/setup_common.h>
 #include <test/util/wallet.h>
+#include <random.h>
 #include <txmempool.h>
 #include <validation.h>
 
@@ -59,4 +60,72 @@ static void AssembleBlock(benchmark::Bench& bench)
     });
 }
 
+// Fill the mempool with clusters: every mature coinbase funds a parent with
+// CLUSTER_CHILDREN outputs, each spent by a child. Fees are random, so some
+// children pay for their parent and some do not.
+static void AssembleClusteredBlock(benchmark::Bench& bench, bool cluster_selection)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+            cluster_selection ? "-blockclusterselection=1" : "-blockclusterselection=0",
+        },
+    };
+
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    CScriptWitness witness;
+    witness.stack.push_back(op_true);
+
+    uint256 witness_program;
+    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+
+    const CScript SCRIPT_PUB{CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()}};
+
+    constexpr size_t NUM_BLOCKS{200};
+    constexpr size_t CLUSTER_CHILDREN{20};
+    std::vector<CTxIn> coinbases;
+    for (size_t b{0}; b < NUM_BLOCKS; ++b) {
+        CTxIn coinbase{MineBlock(test_setup.m_node, SCRIPT_PUB)};
+        if (NUM_BLOCKS - b >= COINBASE_MATURITY) coinbases.push_back(coinbase);
+    }
+    {
+        LOCK(::cs_main); // Required for ::AcceptToMemoryPool.
+
+        FastRandomContext rand{true};
+        for (CTxIn& coinbase : coinbases) {
+            const CAmount value{::ChainstateActive().CoinsTip().AccessCoin(coinbase.prevout).out.nValue};
+            const CAmount output_value{(value - 1000 - static_cast<CAmount>(rand.randrange(10000))) / static_cast<CAmount>(CLUSTER_CHILDREN)};
+
+            CMutableTransaction parent;
+            parent.vin.push_back(coinbase);
+            parent.vin.back().scriptWitness = witness;
+            parent.vout.resize(CLUSTER_CHILDREN, CTxOut{output_value, SCRIPT_PUB});
+            std::vector<CTransactionRef> cluster{MakeTransactionRef(parent)};
+            for (size_t i{0}; i < CLUSTER_CHILDREN; ++i) {
+                CMutableTransaction child;
+                child.vin.emplace_back(cluster.front()->GetHash(), i);
+                child.vin.back().scriptWitness = witness;
+                child.vout.emplace_back(output_value - 1000 - static_cast<CAmount>(rand.randrange(100000)), SCRIPT_PUB);
+                cluster.push_back(MakeTransactionRef(child));
+            }
+            for (const auto& txr : cluster) {
+                TxValidationState state;
+                bool ret{::AcceptToMemoryPool(*test_setup.m_node.mempool, state, txr, nullptr /* plTxnReplaced */, false /* bypass_limits */, /* nAbsurdFee */ 0)};
+                assert(ret);
+            }
+        }
+    }
+
+    bench.run([&] {
+        PrepareBlock(test_setup.m_node, SCRIPT_PUB);
+    });
+}
+
+static void AssembleBlockAncestorSelection(benchmark::Bench& bench) { AssembleClusteredBlock(bench, false); }
+static void AssembleBlockClusterSelection(benchmark::Bench& bench) { AssembleClusteredBlock(bench, true); }
+
 BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockAncestorSelection);
+BENCHMARK(AssembleBlockClusterSelection);
@@ -0,0 +1,62 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <random.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <vector>
+
+static const int BLOCK_INDEX_HEADERS = 1000000;
+
+// Load a synthetic index of 1M headers into a BlockManager the way
+// LoadBlockIndex does: records arrive in hash order, each one creating its
+// own entry and its parent's, then the entries are linked up in height order.
+// Finishes with a walk down the chain to random ancestors.
+static void LoadBlockIndexHeaders(benchmark::Bench& bench)
+{
+    FastRandomContext rng(/* fDeterministic */ true);
+    std::vector<uint256> hashes;
+    hashes.reserve(BLOCK_INDEX_HEADERS);
+    for (int i = 0; i < BLOCK_INDEX_HEADERS; ++i) {
+        hashes.push_back(rng.rand256());
+    }
+    std::vector<int> load_order(BLOCK_INDEX_HEADERS);
+    for (int i = 0; i < BLOCK_INDEX_HEADERS; ++i) {
+        load_order[i] = i;
+    }
+    std::sort(load_order.begin(), load_order.end(), [&](int a, int b) { return hashes[a] < hashes[b]; });
+
+    bench.unit("header").batch(BLOCK_INDEX_HEADERS).epochs(3).run([&] {
+        LOCK(cs_main);
+        BlockManager blockman;
+        std::vector<CBlockIndex*> by_height(BLOCK_INDEX_HEADERS);
+        for (const int height : load_order) {
+            CBlockIndex* pindex = blockman.InsertBlockIndex(hashes[height]);
+            pindex->pprev = height > 0 ? blockman.InsertBlockIndex(hashes[height - 1]) : nullptr;
+            pindex->nHeight = height;
+            pindex->nBits = 0x207fffff;
+            pindex->nTx = 1;
+            by_height[height] = pindex;
+        }
+        for (CBlockIndex* pindex : by_height) {
+            pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+            pindex->BuildSkip();
+        }
+
+        CChain chain;
+        chain.SetTip(by_height.back());
+        uint64_t heights = 0;
+        for (int i = 0; i < 10000; ++i) {
+            heights += chain.Tip()->GetAncestor(i * (BLOCK_INDEX_HEADERS / 10000))->nHeight;
+        }
+        assert(heights > 0);
+        blockman.Unload();
+    });
+}
+
+BENCHMARK(LoadBlockIndexHeaders);
@@ -0,0 +1,101 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <blockprefetch.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <script/script.h>
+#include <streams.h>
+#include <util/memory.h>
+#include <validation.h>
+
+#include <vector>
+
+static const int PIPELINE_BLOCKS = 8;
+static const int PIPELINE_BLOCK_TXS = 1000;
+
+//! A block of PIPELINE_BLOCK_TXS two-in two-out transactions, in network serialization.
+static std::vector<unsigned char> MakeSerializedBlock()
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 0;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < PIPELINE_BLOCK_TXS; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; ++j) {
+            tx.vin[j].prevout = COutPoint(block.vtx.back()->GetHash(), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+            tx.vout[j].nValue = 1000;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    return std::vector<unsigned char>(stream.begin(), stream.end());
+}
+
+// Connect a run of blocks where "reading" a block means deserializing it from
+// its raw bytes and "connecting" it means running CheckBlock on it. With a
+// non-zero depth the reads overlap with the checks of the previous blocks.
+static void ConnectPipeline(benchmark::Bench& bench, unsigned int depth)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+
+    // Every block of the run has the same transactions; give each its own
+    // hash by using the position as nonce (so proof of work is not checked).
+    const std::vector<unsigned char> raw = MakeSerializedBlock();
+    const auto read = [&raw](CBlock& block, const FlatFilePos& pos) {
+        CDataStream stream(raw, SER_NETWORK, PROTOCOL_VERSION);
+        stream >> block;
+        block.nNonce = pos.nPos;
+        return true;
+    };
+
+    std::vector<std::pair<uint256, FlatFilePos>> schedule;
+    for (int i = 0; i < PIPELINE_BLOCKS; ++i) {
+        CBlock block;
+        read(block, FlatFilePos(0, i));
+        schedule.emplace_back(block.GetHash(), FlatFilePos(0, i));
+    }
+
+    std::unique_ptr<BlockPrefetcher> prefetcher;
+    if (depth > 0) prefetcher = MakeUnique<BlockPrefetcher>(read, nullptr, depth);
+
+    bench.unit("block").batch(PIPELINE_BLOCKS).run([&] {
+        for (int i = 0; i < PIPELINE_BLOCKS; ++i) {
+            std::shared_ptr<const CBlock> block;
+            if (prefetcher) {
+                prefetcher->Schedule(std::vector<std::pair<uint256, FlatFilePos>>(schedule.begin() + i, schedule.end()));
+                block = prefetcher->Take(schedule[i].first);
+            }
+            if (!block) {
+                auto fresh = std::make_shared<CBlock>();
+                read(*fresh, schedule[i].second);
+                block = fresh;
+            }
+            BlockValidationState state;
+            bool checked = CheckBlock(*block, state, consensus, /* fCheckPOW */ false);
+            assert(checked);
+        }
+    });
+}
+
+static void ConnectPipelineSerial(benchmark::Bench& bench) { ConnectPipeline(bench, 0); }
+static void ConnectPipelineDepth4(benchmark::Bench& bench) { ConnectPipeline(bench, 4); }
+
+BENCHMARK(ConnectPipelineSerial);
+BENCHMARK(ConnectPipelineDepth4);
@@ -5,8 +5,10 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
+#include <tinyformat.h>
 
 #include <vector>
 
@@ -51,4 +53,75 @@ static void CCoinsCaching(benchmark::Bench& bench)
     ECC_Stop();
 }
 
+//! Outpoints to fill the caches below with.
+static std::vector<COutPoint> MakeOutpoints(size_t count)
+{
+    FastRandomContext rng(/* fDeterministic */ true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    }
+    return outpoints;
+}
+
+//! A P2WPKH output, the most common kind in the UTXO set.
+static Coin MakeCoin()
+{
+    CTxOut out(10000, CScript() << OP_0 << std::vector<unsigned char>(20, 0x11));
+    return Coin(std::move(out), 1, false);
+}
+
+// Fill an empty cache until its accounted memory usage reaches 32 MiB, the
+// way -dbcache bounds the coins cache. Reports the time per added coin and
+// (in the benchmark name) how many coins fit into a MiB.
+static void CoinsCacheDensity(benchmark::Bench& bench)
+{
+    constexpr size_t CACHE_BYTES = 32 << 20;
+    const std::vector<COutPoint> outpoints = MakeOutpoints(CACHE_BYTES / 64);
+
+    const auto fill = [&] {
+        CCoinsView dummy;
+        CCoinsViewCache cache(&dummy);
+        size_t added = 0;
+        while (cache.DynamicMemoryUsage() < CACHE_BYTES) {
+            assert(added < outpoints.size());
+            cache.AddCoin(outpoints[added++], MakeCoin(), false);
+        }
+        return added;
+    };
+
+    const size_t coins = fill();
+    bench.name(strprintf("CoinsCacheDensity (%u coins/MiB)", coins * (1 << 20) / CACHE_BYTES));
+    bench.unit("coin").batch(coins).run([&] {
+        const size_t added = fill();
+        assert(added == coins);
+    });
+}
+
+// Look up coins in a cache of 200k coins, half of them present.
+static void CoinsCacheLookup(benchmark::Bench& bench)
+{
+    constexpr size_t CACHE_COINS = 200000;
+    constexpr size_t LOOKUPS = 1000;
+    const std::vector<COutPoint> outpoints = MakeOutpoints(CACHE_COINS * 2);
+
+    CCoinsView dummy;
+    CCoinsViewCache cache(&dummy);
+    for (size_t i = 0; i < CACHE_COINS; ++i) {
+        cache.AddCoin(outpoints[i * 2], MakeCoin(), false);
+    }
+
+    FastRandomContext rng(/* fDeterministic */ true);
+    size_t found = 0;
+    bench.unit("lookup").batch(LOOKUPS).run([&] {
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            found += cache.HaveCoinInCache(outpoints[rng.randrange(outpoints.size())]);
+        }
+    });
+    assert(found > 0);
+}
+
 BENCHMARK(CCoinsCaching);
+BENCHMARK(CoinsCacheDensity);
+BENCHMARK(CoinsCacheLookup);
@@ -4,11 +4,18 @@
 
 #include <bench/bench.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <key.h>
 #include <prevector.h>
 #include <pubkey.h>
 #include <random.h>
+#include <script/interpreter.h>
+#include <test/util/setup_common.h>
+#include <test/util/transaction_utils.h>
+#include <tinyformat.h>
+#include <uint256.h>
 #include <util/system.h>
+#include <validation.h>
 
 #include <boost/thread/thread.hpp>
 
@@ -18,6 +25,9 @@ static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const unsigned int QUEUE_BATCH_SIZE = 128;
+static const size_t SCRIPT_CHECKS = 2000;
+static const size_t SCRIPT_CHECK_KEYS = 100;
+static const int HASH_JOB_ROUNDS = 16;
 
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
@@ -75,3 +85,105 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     ECC_Stop();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+
+// Measure how the queue scales with the number of threads, for checks that
+// take a few microseconds each, added a few at a time. Every thread count
+// from one up to the number of cores is reported as its own result, so
+// scheduling overhead shows up as the curve flattening.
+static void CCheckQueueScaling(benchmark::Bench& bench)
+{
+    struct HashJob {
+        uint256 data;
+        HashJob() {}
+        explicit HashJob(FastRandomContext& insecure_rand) : data(insecure_rand.rand256()) {}
+        bool operator()()
+        {
+            for (int i = 0; i < HASH_JOB_ROUNDS; ++i) {
+                CSHA256().Write(data.begin(), data.size()).Finalize(data.begin());
+            }
+            return true;
+        }
+        void swap(HashJob& x) { std::swap(data, x.data); }
+    };
+
+    FastRandomContext insecure_rand(true);
+    std::vector<std::vector<HashJob>> vBatches(BATCHES);
+    for (auto& vChecks : vBatches) {
+        vChecks.reserve(BATCH_SIZE);
+        for (size_t x = 0; x < BATCH_SIZE; ++x)
+            vChecks.emplace_back(insecure_rand);
+    }
+
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < GetNumCores(); threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(std::max(GetNumCores(), 1));
+
+    for (const int threads : thread_counts) {
+        CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE};
+        boost::thread_group tg;
+        for (int x = 0; x < threads - 1; ++x) {
+            tg.create_thread([&]{queue.Thread();});
+        }
+        bench.batch(BATCH_SIZE * BATCHES).unit("job").run(strprintf("CCheckQueueScaling/%d", threads), [&] {
+            CCheckQueueControl<HashJob> control(&queue);
+            for (auto vChecks : vBatches) {
+                control.Add(vChecks);
+            }
+            control.Wait();
+        });
+        tg.interrupt_all();
+        tg.join_all();
+    }
+}
+BENCHMARK(CCheckQueueScaling);
+
+// Verify the P2WPKH inputs of a block-sized transaction through the check
+// queue, the way ConnectBlock does. Each key is spent from
+// SCRIPT_CHECKS / SCRIPT_CHECK_KEYS times, as in a block consolidating
+// outputs.
+static void CCheckQueueScriptBlock(benchmark::Bench& bench, bool batch_signatures)
+{
+    // We shouldn't ever be running with the checkqueue on a single core machine.
+    if (GetNumCores() <= 1) return;
+
+    const BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+
+    std::vector<CKey> keys(SCRIPT_CHECK_KEYS);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+    }
+    CMutableTransaction tx_credit;
+    const CTransaction tx_spend(BuildP2WPKHSpendingTransaction(keys, SCRIPT_CHECKS, tx_credit));
+    PrecomputedTransactionData txdata(tx_spend);
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS;
+
+    CCheckQueue<CScriptCheck> queue{QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < GetNumCores() - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+
+    g_batch_signature_checks = batch_signatures;
+    bench.batch(SCRIPT_CHECKS).unit("input").run([&] {
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        std::vector<CScriptCheck> checks;
+        checks.reserve(SCRIPT_CHECKS);
+        for (size_t i = 0; i < SCRIPT_CHECKS; ++i) {
+            checks.emplace_back(tx_credit.vout[i], tx_spend, i, flags, /* cacheIn */ false, &txdata);
+        }
+        control.Add(checks);
+        bool ok = control.Wait();
+        assert(ok);
+    });
+    g_batch_signature_checks = DEFAULT_BATCH_SIGNATURE_CHECKS;
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScriptBlockIndividual(benchmark::Bench& bench) { CCheckQueueScriptBlock(bench, false); }
+static void CCheckQueueScriptBlockBatched(benchmark::Bench& bench) { CCheckQueueScriptBlock(bench, true); }
+
+BENCHMARK(CCheckQueueScriptBlockIndividual);
+BENCHMARK(CCheckQueueScriptBlockBatched);
@@ -0,0 +1,86 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static constexpr int TXS_PER_BLOCK{100};
+
+/** Transactions with a spread of feerates; every fifth one is the child of the one before. */
+static std::vector<std::pair<CTransactionRef, CAmount>> CreateTxs()
+{
+    std::vector<std::pair<CTransactionRef, CAmount>> txs;
+    for (int i = 0; i < TXS_PER_BLOCK; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i % 5 == 4) {
+            tx.vin[0].prevout = COutPoint(txs.back().first->GetHash(), 0);
+        } else {
+            tx.vin[0].scriptSig = CScript() << CScriptNum(i);
+        }
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = COIN;
+        txs.emplace_back(MakeTransactionRef(tx), 1000 + 500 * (i % 40));
+    }
+    return txs;
+}
+
+/** Add the transactions at the given height and mine the first mined_txs of them in the next block. */
+static void ConfirmTxs(CTxMemPool& pool, const std::vector<std::pair<CTransactionRef, CAmount>>& txs, unsigned int height, size_t mined_txs) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    LockPoints lp;
+    std::vector<CTransactionRef> block;
+    for (const auto& tx : txs) {
+        pool.addUnchecked(CTxMemPoolEntry(tx.first, tx.second, /* time */ 0, height, /* spendsCoinbase */ false, /* sigOpCost */ 4, lp));
+        if (block.size() < mined_txs) block.push_back(tx.first);
+    }
+    pool.removeForBlock(block, height + 1);
+    for (const auto& tx : txs) {
+        pool.removeRecursive(*tx.first, MemPoolRemovalReason::EXPIRY);
+    }
+}
+
+static void FeeEstimatorProcessBlock(benchmark::Bench& bench)
+{
+    const auto txs = CreateTxs();
+    TestingSetup test_setup;
+    CBlockPolicyEstimator estimator;
+    CTxMemPool pool(&estimator);
+    LOCK2(cs_main, pool.cs);
+    unsigned int height = 0;
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        ConfirmTxs(pool, txs, ++height, TXS_PER_BLOCK / 2);
+    });
+}
+
+static void FeeEstimatorEstimateSmartFee(benchmark::Bench& bench)
+{
+    const auto txs = CreateTxs();
+    TestingSetup test_setup;
+    CBlockPolicyEstimator estimator;
+    CTxMemPool pool(&estimator);
+    {
+        LOCK2(cs_main, pool.cs);
+        for (unsigned int height = 1; height <= 200; ++height) {
+            ConfirmTxs(pool, txs, height, TXS_PER_BLOCK / 2);
+        }
+    }
+    // Callers ask for the same few targets over and over between blocks
+    bench.unit("estimate").batch(2 * 25).run([&] {
+        for (int target = 1; target <= 25; ++target) {
+            for (bool conservative : {false, true}) {
+                CFeeRate feerate = estimator.estimateSmartFee(target, nullptr, conservative);
+                ankerl::nanobench::doNotOptimizeAway(feerate);
+            }
+        }
+    });
+}
+
+BENCHMARK(FeeEstimatorProcessBlock);
+BENCHMARK(FeeEstimatorEstimateSmartFee);
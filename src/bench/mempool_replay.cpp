@@ -0,0 +1,152 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <miner.h>
+#include <node/mempool_trace.h>
+#include <policy/fees.h>
+#include <script/script.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+/** Latencies of one kind of operation, in nanoseconds */
+class LatencyHistogram
+{
+    std::string m_name;
+    std::vector<int64_t> m_samples;
+
+public:
+    explicit LatencyHistogram(std::string name) : m_name(std::move(name)) {}
+
+    template <typename F>
+    void Time(F f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        m_samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    /** Print percentiles and the number of samples per power of two microseconds */
+    void Print()
+    {
+        if (m_samples.empty()) {
+            tfm::format(std::cout, "%s: no samples\n\n", m_name);
+            return;
+        }
+        std::sort(m_samples.begin(), m_samples.end());
+        const auto percentile = [this](double p) { return m_samples[std::min<size_t>(m_samples.size() - 1, p * m_samples.size())] / 1000.0; };
+        int64_t total = 0;
+        for (const int64_t sample : m_samples) total += sample;
+        tfm::format(std::cout, "%s: %u samples, mean %.1fus, p50 %.1fus, p90 %.1fus, p99 %.1fus, max %.1fus\n",
+                    m_name, m_samples.size(), total / 1000.0 / m_samples.size(), percentile(0.5), percentile(0.9), percentile(0.99), m_samples.back() / 1000.0);
+
+        std::vector<size_t> buckets;
+        for (const int64_t sample : m_samples) {
+            const size_t bucket = sample < 1000 ? 0 : std::ilogb(sample / 1000.0) + 1;
+            if (buckets.size() <= bucket) buckets.resize(bucket + 1);
+            ++buckets[bucket];
+        }
+        const size_t max_count = *std::max_element(buckets.begin(), buckets.end());
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            tfm::format(std::cout, "  < %9dus %9u %s\n", 1 << i, buckets[i], std::string(40 * buckets[i] / max_count, '#'));
+        }
+        tfm::format(std::cout, "\n");
+    }
+};
+
+} // namespace
+
+bool benchmark::ReplayMempoolTrace(const std::string& path)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    std::unique_ptr<MempoolTraceReader> reader;
+    try {
+        reader = MakeUnique<MempoolTraceReader>(path);
+    } catch (const std::exception& e) {
+        tfm::format(std::cerr, "%s\n", e.what());
+        return false;
+    }
+
+    CBlockPolicyEstimator estimator;
+    CTxMemPool pool(&estimator);
+    // The replayed mempool is not built on the regtest chain the assembler sees
+    BlockAssembler::Options options;
+    options.test_block_validity = false;
+
+    LatencyHistogram add_latency("mempool add");
+    LatencyHistogram remove_latency("mempool remove");
+    LatencyHistogram assemble_latency("block assembly");
+    LatencyHistogram block_latency("block connect (mempool and fee estimator)");
+    LatencyHistogram estimate_latency("estimatesmartfee");
+
+    size_t num_records = 0;
+    int64_t first_time = 0;
+    int64_t last_time = 0;
+    MempoolTraceRecord record;
+    try {
+        while (reader->Next(record)) {
+            if (num_records++ == 0) first_time = record.time;
+            last_time = record.time;
+            LOCK2(cs_main, pool.cs);
+            switch (record.type) {
+            case MempoolTraceRecord::ADD: {
+                if (pool.exists(record.tx->GetHash())) break;
+                const CTxMemPoolEntry entry(record.tx, record.fee, record.time / 1000000, record.entry_height, record.spends_coinbase, record.sigop_cost, LockPoints());
+                add_latency.Time([&]() NO_THREAD_SAFETY_ANALYSIS { pool.addUnchecked(entry); });
+                break;
+            }
+            case MempoolTraceRecord::REMOVE: {
+                // Removals for a block follow from the block record
+                const auto reason = static_cast<MemPoolRemovalReason>(record.reason);
+                if (reason == MemPoolRemovalReason::BLOCK || reason == MemPoolRemovalReason::CONFLICT) break;
+                const CTransactionRef tx = pool.get(record.txid);
+                if (!tx) break;
+                remove_latency.Time([&]() NO_THREAD_SAFETY_ANALYSIS { pool.removeRecursive(*tx, reason); });
+                break;
+            }
+            case MempoolTraceRecord::BLOCK: {
+                assemble_latency.Time([&] {
+                    BlockAssembler(pool, Params(), options).CreateNewBlock(CScript() << OP_TRUE);
+                });
+                block_latency.Time([&]() NO_THREAD_SAFETY_ANALYSIS { pool.removeForBlock(record.block_txs, record.height); });
+                for (int target : {2, 6, 24, 144}) {
+                    for (bool conservative : {false, true}) {
+                        estimate_latency.Time([&] { estimator.estimateSmartFee(target, nullptr, conservative); });
+                    }
+                }
+                break;
+            }
+            }
+        }
+    } catch (const std::exception& e) {
+        tfm::format(std::cerr, "Corrupt mempool trace after %u records: %s\n", num_records, e.what());
+        return false;
+    }
+
+    tfm::format(std::cout, "Replayed %u records of a %s trace covering %.1f minutes, %u transactions left in the mempool\n\n",
+                num_records, reader->GetChain(), (last_time - first_time) / 60e6, WITH_LOCK(pool.cs, return pool.size()));
+    add_latency.Print();
+    remove_latency.Print();
+    assemble_latency.Print();
+    block_latency.Print();
+    estimate_latency.Print();
+    return true;
+}
@@ -3,10 +3,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <consensus/validation.h>
+#include <crypto/sha256.h>
+#include <key.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/mining.h>
 #include <test/util/setup_common.h>
 #include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
 
+#include <thread>
 #include <vector>
 
 static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
@@ -91,4 +100,131 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+// Add families of a parent and its children and evict them again, as blocks
+// and expiry do, so that entry nodes and parent/child links are freed and
+// reused over and over.
+static void MempoolChurn(benchmark::Bench& bench)
+{
+    constexpr int NUM_PARENTS{200};
+    constexpr int NUM_CHILDREN{4};
+    std::vector<CTransactionRef> parents;
+    std::vector<CTransactionRef> children;
+    for (int p = 0; p < NUM_PARENTS; ++p) {
+        CMutableTransaction parent;
+        parent.vin.resize(1);
+        parent.vin[0].scriptSig = CScript() << CScriptNum(p);
+        parent.vout.resize(NUM_CHILDREN);
+        for (auto& out : parent.vout) {
+            out.scriptPubKey = CScript() << OP_TRUE;
+            out.nValue = 10 * COIN;
+        }
+        parents.push_back(MakeTransactionRef(parent));
+        for (int c = 0; c < NUM_CHILDREN; ++c) {
+            CMutableTransaction child;
+            child.vin.emplace_back(COutPoint(parent.GetHash(), c));
+            child.vout.emplace_back(9 * COIN, CScript() << OP_TRUE);
+            children.push_back(MakeTransactionRef(child));
+        }
+    }
+    TestingSetup test_setup;
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.unit("tx").batch(parents.size() + children.size()).run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (size_t p = 0; p < parents.size(); ++p) {
+            AddTx(parents[p], pool);
+            for (int c = 0; c < NUM_CHILDREN; ++c) {
+                AddTx(children[p * NUM_CHILDREN + c], pool);
+            }
+        }
+        for (const auto& parent : parents) {
+            pool.removeRecursive(*parent, MemPoolRemovalReason::EXPIRY);
+        }
+        assert(pool.size() == 0);
+    });
+}
+
+// Accept batches of independent, signed P2WPKH spends through
+// AcceptToMemoryPoolConcurrent from several threads at once. Every epoch
+// uses fresh transactions, so that no signature is found in the caches.
+static void MempoolAcceptConcurrent(benchmark::Bench& bench, int num_threads)
+{
+    constexpr size_t BATCH_SIZE{200};
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    uint256 witness_program;
+    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+    const CScript SCRIPT_PUB{CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()}};
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript key_script{GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey()))};
+    const CScript script_code{GetScriptForDestination(PKHash(key.GetPubKey()))};
+
+    // Split a mature coinbase into one output per transaction to accept
+    bench.epochs(5).epochIterations(1);
+    const size_t num_txs{BATCH_SIZE * bench.epochs() * bench.epochIterations()};
+    CMutableTransaction fan_out;
+    fan_out.vin.push_back(MineBlock(test_setup.m_node, SCRIPT_PUB));
+    fan_out.vin.back().scriptWitness.stack.push_back(op_true);
+    for (int i = 0; i < COINBASE_MATURITY; ++i) {
+        MineBlock(test_setup.m_node, SCRIPT_PUB);
+    }
+    const CAmount value{WITH_LOCK(cs_main, return ::ChainstateActive().CoinsTip().AccessCoin(fan_out.vin[0].prevout).out.nValue) - COIN};
+    for (size_t i = 0; i < num_txs; ++i) {
+        fan_out.vout.emplace_back(value / num_txs, key_script);
+    }
+    {
+        LOCK(cs_main);
+        TxValidationState state;
+        bool ret{AcceptToMemoryPool(*test_setup.m_node.mempool, state, MakeTransactionRef(fan_out), nullptr /* plTxnReplaced */, false /* bypass_limits */, /* nAbsurdFee */ 0)};
+        assert(ret);
+    }
+    MineBlock(test_setup.m_node, SCRIPT_PUB);
+
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < num_txs; ++i) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(fan_out.GetHash(), i));
+        tx.vout.emplace_back(fan_out.vout[i].nValue - 1000, SCRIPT_PUB);
+        const uint256 hash{SignatureHash(script_code, tx, 0, SIGHASH_ALL, fan_out.vout[i].nValue, SigVersion::WITNESS_V0)};
+        std::vector<unsigned char> sig;
+        bool signed_ok{key.Sign(hash, sig)};
+        assert(signed_ok);
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptWitness.stack = {sig, ToByteVector(key.GetPubKey())};
+        txs.push_back(MakeTransactionRef(tx));
+    }
+
+    size_t batch{0};
+    bench.unit("tx").batch(BATCH_SIZE).run([&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                for (size_t i = batch * BATCH_SIZE + t; i < (batch + 1) * BATCH_SIZE; i += num_threads) {
+                    TxValidationState state;
+                    bool ret{AcceptToMemoryPoolConcurrent(*test_setup.m_node.mempool, state, txs[i], nullptr /* plTxnReplaced */, /* nAbsurdFee */ 0)};
+                    assert(ret);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ++batch;
+    });
+}
+
+static void MempoolAcceptOneThread(benchmark::Bench& bench) { MempoolAcceptConcurrent(bench, 1); }
+static void MempoolAcceptAllCores(benchmark::Bench& bench) { MempoolAcceptConcurrent(bench, std::max(2, GetNumCores())); }
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolChurn);
+BENCHMARK(MempoolAcceptOneThread);
+BENCHMARK(MempoolAcceptAllCores);
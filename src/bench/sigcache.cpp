@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <uint256.h>
+#include <util/system.h>
+
+#include <thread>
+#include <vector>
+
+static const size_t SIGCACHE_ENTRIES = 100000;
+static const size_t SIGCACHE_OPS_PER_THREAD = 20000;
+
+// Look up and add signature cache entries from one thread per core at once,
+// one addition for every nine lookups, the way validation threads and peers
+// submitting transactions share the cache.
+static void SigCacheContention(benchmark::Bench& bench, size_t shards)
+{
+    const int threads = std::max(GetNumCores(), 2);
+    SignatureCache cache(shards);
+    cache.setup_bytes(DEFAULT_MAX_SIG_CACHE_SIZE << 20);
+
+    FastRandomContext insecure_rand(true);
+    std::vector<uint256> present(SIGCACHE_ENTRIES);
+    for (uint256& entry : present) {
+        entry = insecure_rand.rand256();
+        cache.Set(entry);
+    }
+    cache.Flush();
+
+    bench.batch(threads * SIGCACHE_OPS_PER_THREAD).unit("op").run([&] {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&cache, &present, t] {
+                FastRandomContext rng;
+                for (size_t i = 0; i < SIGCACHE_OPS_PER_THREAD; ++i) {
+                    if (i % 10 == 0) {
+                        cache.Set(rng.rand256());
+                    } else {
+                        cache.Get(present[(t * SIGCACHE_OPS_PER_THREAD + i) % present.size()], false);
+                    }
+                }
+                cache.Flush();
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    });
+}
+
+static void SigCacheContentionSingleShard(benchmark::Bench& bench) { SigCacheContention(bench, 1); }
+static void SigCacheContentionSharded(benchmark::Bench& bench) { SigCacheContention(bench, SIGCACHE_SHARDS); }
+
+BENCHMARK(SigCacheContentionSingleShard);
+BENCHMARK(SigCacheContentionSharded);
@@ -10,7 +10,9 @@
 #include <script/script.h>
 #include <script/standard.h>
 #include <streams.h>
+#include <test/util/setup_common.h>
 #include <test/util/transaction_utils.h>
+#include <validation.h>
 
 #include <array>
 
@@ -96,5 +98,36 @@ static void VerifyNestedIfScript(benchmark::Bench& bench)
     });
 }
 
+// Verify one check queue batch of 128 P2WPKH inputs, spending from 16 keys,
+// on a single thread.
+static void VerifyScriptCheckBatch(benchmark::Bench& bench, bool batch_signatures)
+{
+    const BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+
+    std::vector<CKey> keys(16);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+    }
+    CMutableTransaction tx_credit;
+    const CTransaction tx_spend(BuildP2WPKHSpendingTransaction(keys, 128, tx_credit));
+    PrecomputedTransactionData txdata(tx_spend);
+
+    g_batch_signature_checks = batch_signatures;
+    bench.batch(tx_spend.vin.size()).unit("input").run([&] {
+        std::vector<CScriptCheck> checks;
+        for (size_t i = 0; i < tx_spend.vin.size(); ++i) {
+            checks.emplace_back(tx_credit.vout[i], tx_spend, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, /* cacheIn */ false, &txdata);
+        }
+        bool ok = RunCheckBatch(checks);
+        assert(ok);
+    });
+    g_batch_signature_checks = DEFAULT_BATCH_SIGNATURE_CHECKS;
+}
+
+static void VerifyScriptCheckBatchIndividual(benchmark::Bench& bench) { VerifyScriptCheckBatch(bench, false); }
+static void VerifyScriptCheckBatchBatched(benchmark::Bench& bench) { VerifyScriptCheckBatch(bench, true); }
+
 BENCHMARK(VerifyScriptBench);
 BENCHMARK(VerifyNestedIfScript);
+BENCHMARK(VerifyScriptCheckBatchIndividual);
+BENCHMARK(VerifyScriptCheckBatchBatched);
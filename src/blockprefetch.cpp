@@ -0,0 +1,116 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprefetch.h>
+
+#include <primitives/block.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <assert.h>
+
+BlockPrefetcher::BlockPrefetcher(ReadFn read, WarmFn warm, unsigned int depth)
+    : m_read(std::move(read)), m_warm(std::move(warm)), m_depth(std::max(depth, 1U))
+{
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "blkprefetch", std::function<void()>(std::bind(&BlockPrefetcher::ThreadPrefetch, this)));
+}
+
+BlockPrefetcher::~BlockPrefetcher()
+{
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void BlockPrefetcher::Schedule(const std::vector<std::pair<uint256, FlatFilePos>>& blocks)
+{
+    {
+        LOCK(m_mutex);
+        std::map<uint256, std::shared_ptr<const CBlock>> keep;
+        bool keep_inflight = false;
+        m_pending.clear();
+        for (const auto& entry : blocks) {
+            if (keep.size() + m_pending.size() + (keep_inflight ? 1 : 0) >= m_depth) break;
+            auto it = m_ready.find(entry.first);
+            if (it != m_ready.end()) {
+                keep.insert(*it);
+            } else if (!m_inflight.IsNull() && entry.first == m_inflight) {
+                keep_inflight = true;
+            } else {
+                m_pending.push_back(entry);
+            }
+        }
+        m_ready.swap(keep);
+        if (!m_inflight.IsNull() && !keep_inflight) m_discard_inflight = true;
+    }
+    m_cond.notify_all();
+}
+
+std::shared_ptr<const CBlock> BlockPrefetcher::Take(const uint256& hash)
+{
+    std::shared_ptr<const CBlock> block;
+    {
+        WAIT_LOCK(m_mutex, lock);
+        if (!m_inflight.IsNull() && m_inflight == hash) {
+            // Another read of the same block would only race the prefetch thread.
+            m_discard_inflight = false;
+            m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_inflight != hash; });
+        }
+        auto it = m_ready.find(hash);
+        if (it != m_ready.end()) {
+            block = std::move(it->second);
+            m_ready.erase(it);
+        } else {
+            m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(),
+                                [&](const std::pair<uint256, FlatFilePos>& entry) { return entry.first == hash; }),
+                            m_pending.end());
+        }
+    }
+    // A slot was freed up (or the schedule shrunk), let the prefetch thread continue.
+    m_cond.notify_all();
+    return block;
+}
+
+void BlockPrefetcher::Drain()
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_pending.clear();
+    m_ready.clear();
+    m_discard_inflight = true;
+    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_inflight.IsNull(); });
+}
+
+void BlockPrefetcher::ThreadPrefetch()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+            return m_stop || (!m_pending.empty() && m_ready.size() < m_depth);
+        });
+        if (m_stop) return;
+
+        const std::pair<uint256, FlatFilePos> entry = m_pending.front();
+        m_pending.pop_front();
+        m_inflight = entry.first;
+        m_discard_inflight = false;
+
+        std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+        bool ok;
+        {
+            REVERSE_LOCK(lock);
+            ok = m_read(*block, entry.second) && block->GetHash() == entry.first;
+            if (ok && m_warm) m_warm(*block);
+        }
+
+        if (ok && !m_discard_inflight) {
+            m_ready.emplace(entry.first, std::move(block));
+        }
+        m_inflight.SetNull();
+        m_discard_inflight = false;
+        m_cond.notify_all();
+    }
+}
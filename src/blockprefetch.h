@@ -0,0 +1,96 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BADDCOIN_BLOCKPREFETCH_H
+#define BADDCOIN_BLOCKPREFETCH_H
+
+#include <flatfile.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CBlock;
+
+/** Default for -connectpipelinedepth, number of blocks read ahead of the tip while connecting */
+static const unsigned int DEFAULT_CONNECT_PIPELINE_DEPTH = 4;
+/** Maximum for -connectpipelinedepth */
+static const unsigned int MAX_CONNECT_PIPELINE_DEPTH = 32;
+
+/**
+ * Reads and deserializes blocks on a background thread ahead of the block
+ * currently being connected, so that ConnectTip() finds the next blocks
+ * already in memory instead of waiting on disk I/O while script checks for
+ * the previous block sit idle.
+ *
+ * The owner schedules the blocks it is about to connect in connection order;
+ * at most `depth` of them are held in memory (read or in flight) at any time.
+ * Take() hands over a block once it is needed. Blocks that are not ready
+ * (and not being read) are simply dropped and the caller reads them itself,
+ * so the prefetcher never changes what gets connected, only when the bytes
+ * are loaded.
+ *
+ * The read and warm callbacks run on the prefetch thread and must not take
+ * cs_main.
+ */
+class BlockPrefetcher
+{
+public:
+    //! Reads the block stored at the given position.
+    using ReadFn = std::function<bool(CBlock&, const FlatFilePos&)>;
+    //! Called for every block after it was read, e.g. to warm caches for its inputs.
+    using WarmFn = std::function<void(const CBlock&)>;
+
+    BlockPrefetcher(ReadFn read, WarmFn warm, unsigned int depth);
+    ~BlockPrefetcher();
+
+    BlockPrefetcher(const BlockPrefetcher&) = delete;
+    BlockPrefetcher& operator=(const BlockPrefetcher&) = delete;
+
+    /**
+     * Replace the read-ahead schedule with the given blocks, in the order
+     * they will be connected. Already loaded blocks that are not part of the
+     * new schedule are discarded.
+     */
+    void Schedule(const std::vector<std::pair<uint256, FlatFilePos>>& blocks);
+
+    /**
+     * Hand over a prefetched block. Waits if the block is currently being
+     * read; returns nullptr if it is neither loaded nor in flight.
+     */
+    std::shared_ptr<const CBlock> Take(const uint256& hash);
+
+    /** Drop all scheduled and loaded blocks and wait for any in-flight read to finish. */
+    void Drain();
+
+    unsigned int Depth() const { return m_depth; }
+
+private:
+    void ThreadPrefetch();
+
+    const ReadFn m_read;
+    const WarmFn m_warm;
+    const unsigned int m_depth;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::pair<uint256, FlatFilePos>> m_pending GUARDED_BY(m_mutex);
+    std::map<uint256, std::shared_ptr<const CBlock>> m_ready GUARDED_BY(m_mutex);
+    //! Hash of the block being read by the prefetch thread, null if idle.
+    uint256 m_inflight GUARDED_BY(m_mutex);
+    //! Set when the in-flight block was unscheduled while being read.
+    bool m_discard_inflight GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    std::thread m_thread;
+};
+
+#endif // BADDCOIN_BLOCKPREFETCH_H
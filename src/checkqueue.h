@@ -5,9 +5,12 @@
 #ifndef BADDCOIN_CHECKQUEUE_H
 #define BADDCOIN_CHECKQUEUE_H
 
+#include <crypto/common.h>
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +19,113 @@
 template <typename T>
 class CCheckQueueControl;
 
+/**
+ * Run a batch of checks taken off a CCheckQueue and return whether all of
+ * them passed. Check types that can verify several checks together more
+ * cheaply than one at a time provide an overload of this.
+ */
+template <typename T>
+bool RunCheckBatch(std::vector<T>& checks)
+{
+    for (T& check : checks) {
+        if (!check()) return false;
+    }
+    return true;
+}
+
+/**
+ * Work-stealing deque (Chase and Lev, "Dynamic Circular Work-Stealing Deque")
+ * of ranges of indices into a CCheckQueue's checks. The worker that owns the
+ * deque pushes and takes ranges at the bottom, and other workers steal from
+ * the top, all without taking a lock.
+ */
+class CheckRangeDeque
+{
+private:
+    struct Buffer {
+        const int64_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> items;
+
+        explicit Buffer(int64_t size) : mask(size - 1), items(new std::atomic<uint64_t>[size]()) {}
+        uint64_t Get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+        void Put(int64_t i, uint64_t range) { items[i & mask].store(range, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int64_t> m_top{0};
+    std::atomic<int64_t> m_bottom{0};
+    std::atomic<Buffer*> m_buffer;
+
+    //! Every buffer this deque has used. Thieves may still be reading one
+    //! that has been replaced, so they are only freed with the deque.
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+
+public:
+    CheckRangeDeque()
+    {
+        m_buffers.emplace_back(new Buffer(64));
+        m_buffer.store(m_buffers.back().get());
+    }
+
+    CheckRangeDeque(const CheckRangeDeque&) = delete;
+    CheckRangeDeque& operator=(const CheckRangeDeque&) = delete;
+
+    static uint64_t Pack(uint32_t begin, uint32_t end) { return (uint64_t{begin} << 32) | end; }
+    static uint32_t Begin(uint64_t range) { return range >> 32; }
+    static uint32_t End(uint64_t range) { return (uint32_t)range; }
+
+    //! Add a range at the bottom. Only called by the owner.
+    void Push(uint64_t range)
+    {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed);
+        const int64_t t = m_top.load(std::memory_order_acquire);
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        if (b - t > buffer->mask) {
+            std::unique_ptr<Buffer> grown(new Buffer(2 * (buffer->mask + 1)));
+            for (int64_t i = t; i < b; ++i) {
+                grown->Put(i, buffer->Get(i));
+            }
+            buffer = grown.get();
+            m_buffers.push_back(std::move(grown));
+            m_buffer.store(buffer, std::memory_order_release);
+        }
+        buffer->Put(b, range);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+    //! Remove the most recently pushed range. Only called by the owner.
+    bool Take(uint64_t& range)
+    {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_seq_cst);
+        if (t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        range = buffer->Get(b);
+        if (t == b) {
+            // The last range may be stolen at the same time; only one of us gets it.
+            const bool taken = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return taken;
+        }
+        return true;
+    }
+
+    //! Remove the oldest range. Called by any worker but the owner.
+    bool Steal(uint64_t& range)
+    {
+        while (true) {
+            int64_t t = m_top.load(std::memory_order_seq_cst);
+            const int64_t b = m_bottom.load(std::memory_order_seq_cst);
+            if (t >= b) return false;
+            range = m_buffer.load(std::memory_order_acquire)->Get(t);
+            if (m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return true;
+        }
+    }
+};
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,11 +135,25 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker owns a CheckRangeDeque of ranges of checks. The master pushes
+  * each batch it adds as one range onto its own deque. Workers take ranges
+  * from their own deque or steal them from the others, and split off the
+  * upper half of any range larger than nBatchSize onto their own deque for
+  * others to steal. The mutex and condition variables are only used by
+  * workers that have run out of work to go to sleep.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
+    //! Number of workers, including the master, that get their own deque.
+    //! Any further workers only steal.
+    static const int MAX_WORKERS = 64;
+
+    //! Size of the first storage segment. Each further segment is twice as large as the previous one.
+    static const uint32_t FIRST_SEGMENT_SIZE = 128;
+
     //! Mutex to protect the inner state
     boost::mutex mutex;
 
@@ -39,86 +163,139 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The deques of the master (0) and the worker threads.
+    std::unique_ptr<CheckRangeDeque[]> m_deques;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Which deques have been handed out to worker threads.
+    std::vector<bool> m_deque_used;
+
+    //! Number of deques that have ever been handed out, and so have to be tried when stealing.
+    std::atomic<int> m_deques_active{1};
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The checks added since the master last waited, in segments that never
+    //! move so that workers can run checks while more are being added.
+    std::unique_ptr<T[]> m_segments[32];
+
+    //! Number of checks added since the master last waited. Only used by the master.
+    uint32_t m_added{0};
+
+    //! Bumped whenever work is published, for workers going to sleep to notice it.
+    std::atomic<uint64_t> nGeneration{0};
+
+    //! The number of workers (including the master) that are idle.
+    std::atomic<int> nIdle{0};
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk{true};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo{0};
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The storage slot of the check at the given index.
+    T& Slot(uint32_t index)
+    {
+        // Segment s holds indices [FIRST_SEGMENT_SIZE * (2^s - 1), FIRST_SEGMENT_SIZE * (2^(s+1) - 1)).
+        const uint64_t segment = CountBits(uint64_t{index} / FIRST_SEGMENT_SIZE + 1) - 1;
+        return m_segments[segment][index - FIRST_SEGMENT_SIZE * ((uint64_t{1} << segment) - 1)];
+    }
+
+    //! Wake up sleeping workers after publishing work.
+    void Notify(bool all)
+    {
+        nGeneration++;
+        if (nIdle.load() == 0) return;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (all) {
+            condWorker.notify_all();
+        } else {
+            condWorker.notify_one();
+        }
+        condMaster.notify_one();
+    }
+
+    //! Find a range to work on, preferring the worker's own deque.
+    bool GetWork(int index, uint64_t& range)
+    {
+        if (index >= 0 && index < MAX_WORKERS && m_deques[index].Take(range)) return true;
+        const int active = m_deques_active.load();
+        const int start = std::max(index, 0);
+        for (int i = 1; i <= active; ++i) {
+            const int victim = (start + i) % active;
+            if (victim != index && m_deques[victim].Steal(range)) return true;
+        }
+        return false;
+    }
+
+    //! Run the checks in a range, leaving all but one batch of it to be stolen.
+    void RunRange(int index, uint64_t range, std::vector<T>& vChecks)
+    {
+        uint32_t begin = CheckRangeDeque::Begin(range);
+        uint32_t end = CheckRangeDeque::End(range);
+        if (index >= 0 && index < MAX_WORKERS) {
+            while (end - begin > nBatchSize) {
+                const uint32_t mid = begin + (end - begin) / 2;
+                m_deques[index].Push(CheckRangeDeque::Pack(mid, end));
+                Notify(false);
+                end = mid;
+            }
+        }
+        while (begin < end) {
+            const unsigned int nNow = std::min(end - begin, nBatchSize);
+            vChecks.resize(nNow);
+            for (unsigned int i = 0; i < nNow; i++) {
+                vChecks[i].swap(Slot(begin + i));
+            }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk.load(std::memory_order_relaxed);
+            if (fOk)
+                fOk = RunCheckBatch(vChecks);
+            vChecks.clear();
+            if (!fOk)
+                fAllOk.store(false, std::memory_order_relaxed);
+            begin += nNow;
+            if (nTodo.fetch_sub(nNow) == nNow) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
+        }
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(int index, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        uint64_t range;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+            const uint64_t generation = nGeneration.load();
+            if (GetWork(index, range)) {
+                RunRange(index, range, vChecks);
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                m_added = 0;
+                // return the current status
+                return fRet;
+            }
+            nIdle++;
+            // Sleep until more work is published (or, for the master, all of it is done)
+            while (generation == nGeneration && !(fMaster && nTodo == 0)) {
+                cond.wait(lock);
+            }
+            nIdle--;
         } while (true);
     }
 
@@ -127,33 +304,61 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : m_deques(new CheckRangeDeque[MAX_WORKERS]), m_deque_used(MAX_WORKERS, false), nBatchSize(nBatchSizeIn)
+    {
+        m_deque_used[0] = true;
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        // Hand out a deque for the lifetime of this thread, and take it back
+        // even when the thread is interrupted.
+        struct DequeLease {
+            CCheckQueue& queue;
+            int index{MAX_WORKERS};
+            explicit DequeLease(CCheckQueue& queue_in) : queue(queue_in)
+            {
+                boost::unique_lock<boost::mutex> lock(queue.mutex);
+                for (int i = 1; i < MAX_WORKERS; ++i) {
+                    if (!queue.m_deque_used[i]) {
+                        queue.m_deque_used[i] = true;
+                        index = i;
+                        if (i >= queue.m_deques_active) queue.m_deques_active = i + 1;
+                        break;
+                    }
+                }
+            }
+            ~DequeLease()
+            {
+                boost::unique_lock<boost::mutex> lock(queue.mutex);
+                if (index < MAX_WORKERS) queue.m_deque_used[index] = false;
+            }
+        } lease(*this);
+        Loop(lease.index);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
+        if (vChecks.empty()) return;
+        const uint32_t begin = m_added;
         for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+            const uint64_t segment = CountBits(uint64_t{m_added} / FIRST_SEGMENT_SIZE + 1) - 1;
+            if (!m_segments[segment]) {
+                m_segments[segment].reset(new T[FIRST_SEGMENT_SIZE << segment]);
+            }
+            check.swap(Slot(m_added++));
         }
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        m_deques[0].Push(CheckRangeDeque::Pack(begin, m_added));
+        Notify(vChecks.size() > 1);
     }
 
     ~CCheckQueue()
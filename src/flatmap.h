@@ -0,0 +1,377 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BADDCOIN_FLATMAP_H
+#define BADDCOIN_FLATMAP_H
+
+#include <crypto/common.h>
+#include <memusage.h>
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map with open addressing, built for maps with many small entries such
+ * as the coins cache.
+ *
+ * Entries live in an arena of chunks that is never reallocated, so pointers
+ * and references to entries stay valid until the entry is erased. The index
+ * is a flat power-of-two table of 8-byte slots (entry number and 32 bits of
+ * its hash), probed linearly and kept at most 3/4 full; removals shift later
+ * slots back instead of leaving tombstones. Compared to std::unordered_map
+ * this saves the per-entry allocation, its malloc overhead and the bucket
+ * array of pointers, and lookups touch one cache line of the table before
+ * the entry itself.
+ *
+ * Iteration walks the arena rather than the table, so erasing an element
+ * (e.g. `it = map.erase(it)`) leaves all other iterators valid. Inserting
+ * while iterating is allowed but the new element may or may not be visited.
+ *
+ * Only the subset of the std::unordered_map interface used in this codebase
+ * is provided.
+ */
+template <typename K, typename T, typename Hash>
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+    //! The first chunk holds 2^MIN_CHUNK_BITS entries, every next one twice as
+    //! many, up to 2^MAX_CHUNK_BITS entries per chunk.
+    static constexpr unsigned int MIN_CHUNK_BITS = 2;
+    static constexpr unsigned int MAX_CHUNK_BITS = 14;
+    static constexpr unsigned int GROWING_CHUNKS = MAX_CHUNK_BITS - MIN_CHUNK_BITS;
+    static constexpr uint32_t GROWING_NODES = ((uint32_t{1} << GROWING_CHUNKS) - 1) << MIN_CHUNK_BITS;
+    static constexpr size_t MIN_TABLE_SIZE = 8;
+
+    struct Node {
+        typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type storage;
+        //! Position of this node in the table, NO_NODE if the node is free.
+        uint32_t slot;
+
+        value_type& value() { return *reinterpret_cast<value_type*>(&storage); }
+    };
+
+    struct Slot {
+        //! Arena position of the entry, NO_NODE if the slot is empty.
+        uint32_t node;
+        uint32_t hash;
+    };
+
+    Hash m_hasher;
+    std::vector<Slot> m_table;
+    std::vector<std::unique_ptr<Node[]>> m_chunks;
+    //! Number of nodes in all chunks.
+    uint32_t m_capacity{0};
+    //! Nodes past this position have never been handed out.
+    uint32_t m_used{0};
+    //! Released nodes below m_used, reused before m_used is bumped.
+    std::vector<uint32_t> m_free;
+    size_t m_size{0};
+    //! Memory allocated for the chunks.
+    size_t m_chunk_usage{0};
+
+    static size_t ChunkSize(size_t chunk)
+    {
+        return size_t{1} << (chunk < GROWING_CHUNKS ? MIN_CHUNK_BITS + chunk : MAX_CHUNK_BITS);
+    }
+
+    Node& NodeAt(uint32_t idx) const
+    {
+        if (idx < GROWING_NODES) {
+            const uint32_t chunk = CountBits((idx >> MIN_CHUNK_BITS) + 1) - 1;
+            return m_chunks[chunk][idx - (((uint32_t{1} << chunk) - 1) << MIN_CHUNK_BITS)];
+        }
+        idx -= GROWING_NODES;
+        return m_chunks[GROWING_CHUNKS + (idx >> MAX_CHUNK_BITS)][idx & ((uint32_t{1} << MAX_CHUNK_BITS) - 1)];
+    }
+
+    //! First node in use at or after idx, NO_NODE if there is none.
+    uint32_t NextNode(uint32_t idx) const
+    {
+        while (idx < m_used && NodeAt(idx).slot == NO_NODE) ++idx;
+        return idx < m_used ? idx : NO_NODE;
+    }
+
+    uint32_t HashKey(const K& key) const { return static_cast<uint32_t>(m_hasher(key)); }
+
+    uint32_t FindNode(const K& key, uint32_t hash) const
+    {
+        if (m_table.empty()) return NO_NODE;
+        const size_t mask = m_table.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = m_table[i];
+            if (slot.node == NO_NODE) return NO_NODE;
+            if (slot.hash == hash && NodeAt(slot.node).value().first == key) return slot.node;
+        }
+    }
+
+    void InsertSlot(uint32_t node, uint32_t hash)
+    {
+        const size_t mask = m_table.size() - 1;
+        size_t i = hash & mask;
+        while (m_table[i].node != NO_NODE) i = (i + 1) & mask;
+        m_table[i].node = node;
+        m_table[i].hash = hash;
+        NodeAt(node).slot = i;
+    }
+
+    void EraseSlot(size_t hole)
+    {
+        const size_t mask = m_table.size() - 1;
+        for (size_t i = (hole + 1) & mask; m_table[i].node != NO_NODE; i = (i + 1) & mask) {
+            // Move the entry back into the hole unless its home slot lies
+            // after the hole, in which case it would become unreachable.
+            const size_t home = m_table[i].hash & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                m_table[hole] = m_table[i];
+                NodeAt(m_table[hole].node).slot = hole;
+                hole = i;
+            }
+        }
+        m_table[hole].node = NO_NODE;
+    }
+
+    void Rehash(size_t table_size)
+    {
+        std::vector<Slot> old_table(table_size, Slot{NO_NODE, 0});
+        old_table.swap(m_table);
+        for (const Slot& slot : old_table) {
+            if (slot.node != NO_NODE) InsertSlot(slot.node, slot.hash);
+        }
+    }
+
+    //! Make room in the table for one more entry.
+    void ReserveSlot()
+    {
+        if ((m_size + 1) * 4 <= m_table.size() * 3) return;
+        Rehash(m_table.empty() ? MIN_TABLE_SIZE : m_table.size() * 2);
+    }
+
+    uint32_t AllocateNode()
+    {
+        uint32_t idx;
+        if (!m_free.empty()) {
+            idx = m_free.back();
+            m_free.pop_back();
+        } else {
+            if (m_used == m_capacity) {
+                const size_t chunk_size = ChunkSize(m_chunks.size());
+                m_chunks.emplace_back(new Node[chunk_size]);
+                m_capacity += chunk_size;
+                m_chunk_usage += memusage::MallocUsage(chunk_size * sizeof(Node));
+            }
+            idx = m_used++;
+        }
+        NodeAt(idx).slot = NO_NODE;
+        return idx;
+    }
+
+    void ReleaseNode(uint32_t idx)
+    {
+        Node& node = NodeAt(idx);
+        node.value().~value_type();
+        node.slot = NO_NODE;
+        m_free.push_back(idx);
+    }
+
+    template <bool Const>
+    class Iterator
+    {
+        friend class flatmap;
+        template <bool> friend class Iterator;
+        typedef typename std::conditional<Const, const flatmap, flatmap>::type Map;
+
+        Map* m_map{nullptr};
+        uint32_t m_idx{NO_NODE};
+
+        Iterator(Map* map, uint32_t idx) : m_map(map), m_idx(idx) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flatmap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<Const, const value_type&, value_type&>::type reference;
+
+        Iterator() = default;
+        template <bool C = Const, typename = typename std::enable_if<C>::type>
+        Iterator(const Iterator<false>& other) : m_map(other.m_map), m_idx(other.m_idx) {}
+
+        reference operator*() const { return m_map->NodeAt(m_idx).value(); }
+        pointer operator->() const { return &m_map->NodeAt(m_idx).value(); }
+        Iterator& operator++() { m_idx = m_map->NextNode(m_idx + 1); return *this; }
+        Iterator operator++(int) { Iterator ret(*this); ++*this; return ret; }
+
+        friend bool operator==(const Iterator& a, const Iterator& b) { return a.m_idx == b.m_idx; }
+        friend bool operator!=(const Iterator& a, const Iterator& b) { return a.m_idx != b.m_idx; }
+    };
+
+public:
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    flatmap() = default;
+    ~flatmap() { clear(); }
+
+    flatmap(const flatmap&) = delete;
+    flatmap& operator=(const flatmap&) = delete;
+
+    iterator begin() { return iterator(this, NextNode(0)); }
+    iterator end() { return iterator(this, NO_NODE); }
+    const_iterator begin() const { return const_iterator(this, NextNode(0)); }
+    const_iterator end() const { return const_iterator(this, NO_NODE); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    bool empty() const { return m_size == 0; }
+    size_type size() const { return m_size; }
+    size_type bucket_count() const { return m_table.size(); }
+
+    iterator find(const K& key) { return iterator(this, FindNode(key, HashKey(key))); }
+    const_iterator find(const K& key) const { return const_iterator(this, FindNode(key, HashKey(key))); }
+    size_type count(const K& key) const { return FindNode(key, HashKey(key)) != NO_NODE ? 1 : 0; }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        ReserveSlot();
+        const uint32_t idx = AllocateNode();
+        Node& node = NodeAt(idx);
+        try {
+            ::new (&node.storage) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            m_free.push_back(idx);
+            throw;
+        }
+        const uint32_t hash = HashKey(node.value().first);
+        const uint32_t existing = FindNode(node.value().first, hash);
+        if (existing != NO_NODE) {
+            ReleaseNode(idx);
+            return std::make_pair(iterator(this, existing), false);
+        }
+        InsertSlot(idx, hash);
+        ++m_size;
+        return std::make_pair(iterator(this, idx), true);
+    }
+
+    T& operator[](const K& key)
+    {
+        const uint32_t idx = FindNode(key, HashKey(key));
+        if (idx != NO_NODE) return NodeAt(idx).value().second;
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        const uint32_t idx = it.m_idx;
+        assert(idx != NO_NODE);
+        EraseSlot(NodeAt(idx).slot);
+        ReleaseNode(idx);
+        if (--m_size == 0) {
+            // Start handing out nodes from the front again.
+            m_free.clear();
+            m_used = 0;
+            return end();
+        }
+        return iterator(this, NextNode(idx + 1));
+    }
+
+    size_type erase(const K& key)
+    {
+        const uint32_t idx = FindNode(key, HashKey(key));
+        if (idx == NO_NODE) return 0;
+        erase(const_iterator(this, idx));
+        return 1;
+    }
+
+    //! Destroy all entries and release all memory.
+    void clear()
+    {
+        for (uint32_t idx = NextNode(0); idx != NO_NODE; idx = NextNode(idx + 1)) {
+            NodeAt(idx).value().~value_type();
+        }
+        std::vector<Slot>().swap(m_table);
+        std::vector<std::unique_ptr<Node[]>>().swap(m_chunks);
+        std::vector<uint32_t>().swap(m_free);
+        m_capacity = m_used = 0;
+        m_size = 0;
+        m_chunk_usage = 0;
+    }
+
+    /**
+     * Move all entries to the front of the arena and release the chunks and
+     * table space that are no longer needed. Erasing entries alone never
+     * returns memory, as freed entries are kept for reuse.
+     *
+     * Invalidates all iterators, pointers and references.
+     */
+    void compact()
+    {
+        if (m_size == 0) {
+            clear();
+            return;
+        }
+        // Fill the holes below m_size with the entries above it.
+        uint32_t hole = 0;
+        uint32_t last = m_used;
+        while (true) {
+            while (hole < m_size && NodeAt(hole).slot != NO_NODE) ++hole;
+            if (hole == m_size) break;
+            do --last; while (NodeAt(last).slot == NO_NODE);
+            Node& from = NodeAt(last);
+            Node& to = NodeAt(hole);
+            ::new (&to.storage) value_type(std::move(from.value()));
+            from.value().~value_type();
+            to.slot = from.slot;
+            from.slot = NO_NODE;
+            m_table[to.slot].node = hole;
+        }
+        m_used = m_size;
+        std::vector<uint32_t>().swap(m_free);
+        while (m_capacity - ChunkSize(m_chunks.size() - 1) >= m_used) {
+            const size_t chunk_size = ChunkSize(m_chunks.size() - 1);
+            m_chunks.pop_back();
+            m_capacity -= chunk_size;
+            m_chunk_usage -= memusage::MallocUsage(chunk_size * sizeof(Node));
+        }
+        size_t table_size = MIN_TABLE_SIZE;
+        while (m_size * 4 > table_size * 3) table_size *= 2;
+        if (table_size < m_table.size()) Rehash(table_size);
+    }
+
+    //! Memory allocated by the map, not counting what the entries allocate themselves.
+    size_t DynamicMemoryUsage() const
+    {
+        return m_chunk_usage +
+               memusage::MallocUsage(m_table.capacity() * sizeof(Slot)) +
+               memusage::MallocUsage(m_chunks.capacity() * sizeof(std::unique_ptr<Node[]>)) +
+               memusage::MallocUsage(m_free.capacity() * sizeof(uint32_t));
+    }
+};
+
+namespace memusage
+{
+template <typename K, typename T, typename Hash>
+static inline size_t DynamicUsage(const flatmap<K, T, Hash>& m)
+{
+    return m.DynamicMemoryUsage();
+}
+} // namespace memusage
+
+#endif // BADDCOIN_FLATMAP_H
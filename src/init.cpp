@@ -32,6 +32,7 @@
 #include <net_processing.h>
 #include <netbase.h>
 #include <node/context.h>
+#include <node/mempool_trace.h>
 #include <node/ui_interface.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
@@ -85,6 +86,7 @@
 #endif
 
 static bool fFeeEstimatesInitialized = false;
+static bool fScriptCachesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
@@ -201,6 +203,8 @@ void Shutdown(NodeContext& node)
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (node.peerman) UnregisterValidationInterface(node.peerman.get());
+    if (node.block_template_manager) UnregisterValidationInterface(node.block_template_manager.get());
+    if (node.mempool_trace_recorder) UnregisterValidationInterface(node.mempool_trace_recorder.get());
     // Follow the lock order requirements:
     // * CheckForStaleTipAndEvictPeers locks cs_main before indirectly calling GetExtraOutboundCount
     //   which locks cs_vNodes.
@@ -212,6 +216,9 @@ void Shutdown(NodeContext& node)
     // Thus the implicit locking order requirement is: (1) cs_main, (2) g_cs_orphans, (3) cs_vNodes.
     if (node.connman) {
         node.connman->StopThreads();
+        // The transaction validation threads hold references to nodes, so stop
+        // them once the message handler no longer queues transactions
+        if (node.peerman) node.peerman->StopTxValidation();
         LOCK2(::cs_main, ::g_cs_orphans);
         node.connman->StopNodes();
     }
@@ -228,6 +235,8 @@ void Shutdown(NodeContext& node)
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     node.peerman.reset();
+    node.block_template_manager.reset();
+    node.mempool_trace_recorder.reset();
     node.connman.reset();
     node.banman.reset();
 
@@ -235,6 +244,11 @@ void Shutdown(NodeContext& node)
         DumpMempool(*node.mempool);
     }
 
+    if (fScriptCachesInitialized) {
+        if (node.args->GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIG_CACHE)) DumpScriptCaches();
+        fScriptCachesInitialized = false;
+    }
+
     if (fFeeEstimatesInitialized)
     {
         ::feeEstimator.FlushUnconfirmed();
@@ -283,6 +297,9 @@ void Shutdown(NodeContext& node)
                 chainstate->ResetCoinsViews();
             }
         }
+        if (g_block_index_snapshot) {
+            DumpBlockIndexSnapshot(*node.chainman);
+        }
         pblocktree.reset();
     }
     for (const auto& client : node.chain_clients) {
@@ -394,6 +411,8 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     argsman.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-batchsigchecks", strprintf("Whether script verification threads defer the signature checks of a batch of scripts and verify them together (default: %u)", DEFAULT_BATCH_SIGNATURE_CHECKS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockindexsnapshot", strprintf("Whether to save the block index to a snapshot file on shutdown and load it from there on restart while it still matches the block database (default: %u)", DEFAULT_BLOCK_INDEX_SNAPSHOT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     argsman.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -401,9 +420,11 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless the peer has the 'forcerelay' permission. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-conf=<file>", strprintf("Specify path to read-only configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BADDCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-connectpipelinedepth=<n>", strprintf("Number of blocks to read from disk ahead of the one being connected (0 to %u, 0 = disable, default: %u)", MAX_CONNECT_PIPELINE_DEPTH, DEFAULT_CONNECT_PIPELINE_DEPTH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     argsman.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-dbcacheretain=<n>", strprintf("Percentage of -dbcache kept filled with recently used coins when the coins cache is written to disk (0 to %d, 0 = empty the cache, default: %d)", MAX_DBCACHE_RETAIN, DEFAULT_DBCACHE_RETAIN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     argsman.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -415,6 +436,8 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-persistmempooltrusted", strprintf("Skip the script checks of transactions loaded on restart if the chain tip has not changed since the mempool was saved (default: %u)", DEFAULT_PERSIST_MEMPOOL_TRUSTED), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-persistsigcache", strprintf("Whether to save the signature and script execution caches on shutdown and load them on restart (default: %u)", DEFAULT_PERSIST_SIG_CACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BADDCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
@@ -428,6 +451,8 @@ void SetupServerArgs(NodeContext& node)
     hidden_args.emplace_back("-sysperms");
 #endif
     argsman.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-txvalidationthreads=<n>", strprintf("Set the number of threads validating transactions received from peers (0 to %d, 0 = validate on the message handler thread, default: %d)", MAX_TX_VALIDATION_THREADS, DEFAULT_TX_VALIDATION_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-utxoprefetchthreads=<n>", strprintf("Number of threads looking up the inputs of blocks about to be connected in the UTXO database (0 to %d, 0 = disable, default: %d)", MAX_UTXO_PREFETCH_THREADS, DEFAULT_UTXO_PREFETCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blockfilterindex=<type>",
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
                  " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.",
@@ -532,6 +557,7 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-mocktime=<n>", "Replace actual time with " + UNIX_EPOCH_TIME + " (default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    argsman.AddArg("-mempooltrace=<file>", "Record the transactions entering and leaving the mempool and the connected blocks to <file>, for replaying with bench_baddcoin. Relative paths will be prefixed by a net-specific datadir location.", ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-printpriority", strprintf("Log transaction fee per kB when mining blocks (default: %u)", DEFAULT_PRINTPRIORITY), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-printtoconsole", "Send trace/debug info to console (default: 1 when no -daemon. To disable logging to file, set -nodebuglogfile)", ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-shrinkdebugfile", "Shrink debug.log file on client startup (default: 1 when no -debug)", ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
@@ -551,6 +577,7 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-whitelistrelay", strprintf("Add 'relay' permission to whitelisted inbound peers with default permissions. This will accept relayed transactions even when not relaying transactions (default: %d)", DEFAULT_WHITELISTRELAY), ArgsManager::ALLOW_ANY, OptionsCategory::NODE_RELAY);
 
 
+    argsman.AddArg("-blockclusterselection", strprintf("Select block transactions by merging the mempool's precomputed cluster chunks instead of recomputing ancestor packages (default: %u)", DEFAULT_BLOCK_CLUSTER_SELECTION), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
@@ -1286,6 +1313,10 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (args.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIG_CACHE)) {
+        LoadScriptCaches();
+    }
+    fScriptCachesInitialized = true;
 
     int script_threads = args.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (script_threads <= 0) {
@@ -1308,6 +1339,17 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
         }
     }
 
+    const int64_t pipeline_depth = args.GetArg("-connectpipelinedepth", DEFAULT_CONNECT_PIPELINE_DEPTH);
+    g_connect_pipeline_depth = std::max<int64_t>(0, std::min<int64_t>(pipeline_depth, MAX_CONNECT_PIPELINE_DEPTH));
+    LogPrintf("Block connection reads ahead %u blocks\n", g_connect_pipeline_depth);
+    const int64_t prefetch_threads = args.GetArg("-utxoprefetchthreads", DEFAULT_UTXO_PREFETCH_THREADS);
+    g_utxo_prefetch_threads = std::max<int64_t>(0, std::min<int64_t>(prefetch_threads, MAX_UTXO_PREFETCH_THREADS));
+    LogPrintf("Using %d threads for UTXO prefetching\n", g_utxo_prefetch_threads);
+    const int64_t dbcache_retain = args.GetArg("-dbcacheretain", DEFAULT_DBCACHE_RETAIN);
+    g_dbcache_retain = std::max<int64_t>(0, std::min<int64_t>(dbcache_retain, MAX_DBCACHE_RETAIN));
+    g_block_index_snapshot = args.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT);
+    g_batch_signature_checks = args.GetBoolArg("-batchsigchecks", DEFAULT_BATCH_SIGNATURE_CHECKS);
+
     assert(!node.scheduler);
     node.scheduler = MakeUnique<CScheduler>();
 
@@ -1379,6 +1421,18 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
     node.peerman.reset(new PeerManager(chainparams, *node.connman, node.banman.get(), *node.scheduler, chainman, *node.mempool));
     RegisterValidationInterface(node.peerman.get());
 
+    node.block_template_manager = MakeUnique<BlockTemplateManager>(*node.mempool, chainparams);
+    RegisterValidationInterface(node.block_template_manager.get());
+
+    if (args.IsArgSet("-mempooltrace") && !args.IsArgNegated("-mempooltrace")) {
+        const fs::path trace_path = AbsPathForConfigVal(args.GetArg("-mempooltrace", ""));
+        node.mempool_trace_recorder = MakeUnique<MempoolTraceRecorder>(*node.mempool, trace_path);
+        if (!node.mempool_trace_recorder->IsRecording()) {
+            return InitError(strprintf(_("Cannot write mempool trace %s"), trace_path.string()));
+        }
+        RegisterValidationInterface(node.mempool_trace_recorder.get());
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string& cmt : args.GetArgs("-uacomment")) {
@@ -1952,6 +2006,10 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
             connOptions.m_specified_outgoing = connect;
         }
     }
+    const int tx_validation_threads = std::max(0, std::min<int>(args.GetArg("-txvalidationthreads", DEFAULT_TX_VALIDATION_THREADS), MAX_TX_VALIDATION_THREADS));
+    LogPrintf("Transaction validation uses %d threads\n", tx_validation_threads);
+    node.peerman->StartTxValidation(tx_validation_threads);
+
     if (!node.connman->Start(*node.scheduler, connOptions)) {
         return false;
     }
@@ -22,6 +22,7 @@
 #include <util/system.h>
 
 #include <algorithm>
+#include <set>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -53,6 +54,8 @@ void RegenerateCommitments(CBlock& block)
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    cluster_selection = DEFAULT_BLOCK_CLUSTER_SELECTION;
+    test_block_validity = true;
 }
 
 BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options)
@@ -62,6 +65,8 @@ BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& pa
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    m_cluster_selection = options.cluster_selection;
+    m_test_block_validity = options.test_block_validity;
 }
 
 static BlockAssembler::Options DefaultOptions()
@@ -76,6 +81,7 @@ static BlockAssembler::Options DefaultOptions()
     } else {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    options.cluster_selection = gArgs.GetBoolArg("-blockclusterselection", DEFAULT_BLOCK_CLUSTER_SELECTION);
     return options;
 }
 
@@ -147,7 +153,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (m_cluster_selection) {
+        addClusterTxs(nPackagesSelected);
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -176,7 +186,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
     BlockValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+    if (m_test_block_validity && !TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, state.ToString()));
     }
     int64_t nTime2 = GetTimeMicros();
@@ -216,14 +226,21 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
 {
     for (CTxMemPool::txiter it : package) {
-        if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
-            return false;
-        if (!fIncludeWitness && it->GetTx().HasWitness())
+        if (!TestTransaction(*it))
             return false;
     }
     return true;
 }
 
+bool BlockAssembler::TestTransaction(const CTxMemPoolEntry& entry) const
+{
+    if (m_test_block_validity && !IsFinalTx(entry.GetTx(), nHeight, nLockTimeCutoff))
+        return false;
+    if (!fIncludeWitness && entry.GetTx().HasWitness())
+        return false;
+    return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblocktemplate->block.vtx.emplace_back(iter->GetSharedTx());
@@ -435,6 +452,80 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+// Every cluster in the mempool keeps its transactions in chunks of
+// non-increasing feerate, so the best chunk not yet considered is always the
+// first remaining chunk of some cluster. Selection is a merge of those lists:
+// keep a heap of each cluster's next chunk and take chunks best-first. If a
+// chunk cannot be included, the rest of its cluster is skipped as well, since
+// later chunks may spend its outputs.
+void BlockAssembler::addClusterTxs(int &nPackagesSelected)
+{
+    typedef std::pair<const CTxMemPoolCluster*, size_t> ClusterChunk;
+    const auto worse = [](const ClusterChunk& a, const ClusterChunk& b) {
+        const CTxMemPoolCluster::Chunk& chunk_a = a.first->chunks[a.second];
+        const CTxMemPoolCluster::Chunk& chunk_b = b.first->chunks[b.second];
+        if (chunk_b.HasHigherFeerate(chunk_a)) return true;
+        if (chunk_a.HasHigherFeerate(chunk_b)) return false;
+        // Break ties by txid, so that templates do not depend on cluster order
+        const size_t begin_a = a.second == 0 ? 0 : a.first->chunks[a.second - 1].end;
+        const size_t begin_b = b.second == 0 ? 0 : b.first->chunks[b.second - 1].end;
+        return b.first->txs[begin_b]->GetTx().GetHash() < a.first->txs[begin_a]->GetTx().GetHash();
+    };
+
+    std::vector<ClusterChunk> heap;
+    heap.reserve(m_mempool.GetClusters().size());
+    for (const auto& cluster : m_mempool.GetClusters()) {
+        heap.emplace_back(cluster.get(), 0);
+    }
+    std::make_heap(heap.begin(), heap.end(), worse);
+
+    // Limit the number of attempts to add transactions to the block when it is
+    // close to full, as in addPackageTxs.
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), worse);
+        const ClusterChunk next = heap.back();
+        heap.pop_back();
+        const CTxMemPoolCluster& cluster = *next.first;
+        const CTxMemPoolCluster::Chunk& chunk = cluster.chunks[next.second];
+        const size_t begin = next.second == 0 ? 0 : cluster.chunks[next.second - 1].end;
+
+        if (chunk.fee < blockMinFeeRate.GetFee(chunk.size)) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+
+        if (!TestPackage(chunk.size, chunk.sigops)) {
+            ++nConsecutiveFailed;
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                    nBlockMaxWeight - 4000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        bool valid = true;
+        for (size_t i = begin; i < chunk.end && valid; ++i) {
+            valid = TestTransaction(*cluster.txs[i]);
+        }
+        if (!valid) continue;
+
+        nConsecutiveFailed = 0;
+        for (size_t i = begin; i < chunk.end; ++i) {
+            AddToBlock(m_mempool.mapTx.iterator_to(*cluster.txs[i]));
+        }
+        ++nPackagesSelected;
+
+        if (next.second + 1 < cluster.chunks.size()) {
+            heap.emplace_back(next.first, next.second + 1);
+            std::push_heap(heap.begin(), heap.end(), worse);
+        }
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -453,3 +544,203 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+BlockTemplateManager::BlockTemplateManager(CTxMemPool& mempool, const CChainParams& chainparams)
+    : m_mempool(mempool),
+      m_chainparams(chainparams),
+      m_options(DefaultOptions()),
+      m_block_max_weight(std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, m_options.nBlockMaxWeight)))
+{
+}
+
+void BlockTemplateManager::Rebuild()
+{
+    // Leave no template behind if CreateNewBlock throws
+    m_template.reset();
+    m_prev = nullptr;
+
+    const unsigned int transactions_updated = m_mempool.GetTransactionsUpdated();
+    const CBlockIndex* prev = ::ChainActive().Tip();
+    std::unique_ptr<CBlockTemplate> block_template = BlockAssembler(m_mempool, m_chainparams, m_options).CreateNewBlock(CScript() << OP_TRUE);
+    if (!block_template) return;
+
+    const CBlock& block = block_template->block;
+    m_block_weight = 4000;
+    m_block_sigops_cost = 400;
+    m_tx_index.clear();
+    m_tx_index.reserve(block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        m_tx_index.emplace(block.vtx[i]->GetHash(), i);
+        if (i == 0) continue;
+        m_block_weight += GetTransactionWeight(*block.vtx[i]);
+        m_block_sigops_cost += block_template->vTxSigOpsCost[i];
+    }
+    m_fees = -block_template->vTxFees[0];
+    m_subsidy = block.vtx[0]->vout[0].nValue - m_fees;
+    m_lock_time_cutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                         ? prev->GetMedianTimePast()
+                         : block.GetBlockTime();
+    m_include_witness = IsWitnessEnabled(prev, m_chainparams.GetConsensus());
+    m_tx_seq.assign(block.vtx.size(), 0);
+    m_removed.clear();
+
+    m_template = std::move(block_template);
+    m_prev = prev;
+    m_stale = false;
+    m_coinbase_dirty = false;
+    m_build_time = GetTime();
+    m_id.build = std::max<uint64_t>(m_id.build + 1, GetTimeMicros());
+    m_id.seq = 0;
+    m_transactions_updated = transactions_updated;
+}
+
+void BlockTemplateManager::UpdateCoinbase()
+{
+    CBlock& block = m_template->block;
+    CMutableTransaction coinbase{*block.vtx[0]};
+    coinbase.vout[0].nValue = m_fees + m_subsidy;
+    const int commitpos = GetWitnessCommitmentIndex(block);
+    if (commitpos != -1) {
+        coinbase.vout.erase(coinbase.vout.begin() + commitpos);
+    }
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    m_template->vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, m_prev, m_chainparams.GetConsensus());
+    m_template->vTxFees[0] = -m_fees;
+    m_coinbase_dirty = false;
+}
+
+BlockTemplateManager::Snapshot BlockTemplateManager::GetTemplate(const TemplateId* since)
+{
+    LOCK2(cs_main, m_mempool.cs);
+    LOCK(m_mutex);
+    m_active = true;
+    if (!m_template || m_prev != ::ChainActive().Tip() ||
+        (m_stale && GetTime() - m_build_time >= BLOCK_TEMPLATE_REBUILD_INTERVAL)) {
+        Rebuild();
+        if (!m_template) throw std::runtime_error("Failed to create block template");
+    }
+    if (m_coinbase_dirty) UpdateCoinbase();
+
+    Snapshot snapshot;
+    snapshot.block_template = *m_template;
+    snapshot.prev = m_prev;
+    snapshot.id = m_id;
+    snapshot.transactions_updated = m_transactions_updated;
+    if (since && since->build == m_id.build && since->seq <= m_id.seq) {
+        snapshot.delta = true;
+        while (snapshot.unchanged < m_tx_seq.size() && m_tx_seq[snapshot.unchanged] <= since->seq) {
+            ++snapshot.unchanged;
+        }
+        for (const auto& removed : m_removed) {
+            if (removed.first > since->seq) snapshot.removed.push_back(removed.second);
+        }
+    }
+    return snapshot;
+}
+
+void BlockTemplateManager::MarkStale()
+{
+    LOCK(m_mutex);
+    m_stale = true;
+}
+
+void BlockTemplateManager::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload) return;
+
+    // Have the template for the new tip ready before miners ask for it.
+    LOCK2(cs_main, m_mempool.cs);
+    LOCK(m_mutex);
+    if (!m_active || m_prev == ::ChainActive().Tip()) return;
+    try {
+        Rebuild();
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
+
+void BlockTemplateManager::TransactionAddedToMempool(const CTransactionRef& tx)
+{
+    LOCK2(cs_main, m_mempool.cs);
+    LOCK(m_mutex);
+    // Templates for an outdated tip are rebuilt on the next request anyway.
+    if (!m_template || m_prev != ::ChainActive().Tip()) return;
+
+    const uint256& txid = tx->GetHash();
+    if (m_tx_index.count(txid)) return;
+    // Notifications are asynchronous, the transaction may be gone already.
+    const auto it = m_mempool.mapTx.find(txid);
+    if (it == m_mempool.mapTx.end()) return;
+    const CTxMemPoolEntry& entry = *it;
+
+    if (entry.GetModifiedFee() < m_options.blockMinFeeRate.GetFee(entry.GetTxSize())) return;
+    for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+        if (!m_tx_index.count(parent.GetTx().GetHash())) {
+            m_stale = true;
+            return;
+        }
+    }
+    if (m_block_weight + WITNESS_SCALE_FACTOR * entry.GetTxSize() >= m_block_max_weight ||
+        m_block_sigops_cost + entry.GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST) {
+        m_stale = true;
+        return;
+    }
+    if (!IsFinalTx(*tx, m_prev->nHeight + 1, m_lock_time_cutoff) ||
+        (!m_include_witness && tx->HasWitness())) {
+        return;
+    }
+
+    m_tx_index.emplace(txid, m_template->block.vtx.size());
+    m_template->block.vtx.push_back(tx);
+    m_template->vTxFees.push_back(entry.GetFee());
+    m_template->vTxSigOpsCost.push_back(entry.GetSigOpCost());
+    m_tx_seq.push_back(++m_id.seq);
+    m_block_weight += entry.GetTxWeight();
+    m_block_sigops_cost += entry.GetSigOpCost();
+    m_fees += entry.GetFee();
+    m_coinbase_dirty = true;
+    m_transactions_updated = m_mempool.GetTransactionsUpdated();
+}
+
+void BlockTemplateManager::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason)
+{
+    LOCK(m_mutex);
+    if (!m_template) return;
+    const auto found = m_tx_index.find(tx->GetHash());
+    if (found == m_tx_index.end()) return;
+
+    // Drop the transaction and everything in the template that spends from
+    // it; descendants always come later in the block.
+    CBlock& block = m_template->block;
+    const size_t first = found->second;
+    std::set<uint256> removed{tx->GetHash()};
+    const uint64_t seq = ++m_id.seq;
+    size_t out = first;
+    for (size_t i = first; i < block.vtx.size(); ++i) {
+        const CTransaction& block_tx = *block.vtx[i];
+        bool remove = i == first;
+        for (size_t j = 0; !remove && j < block_tx.vin.size(); ++j) {
+            remove = removed.count(block_tx.vin[j].prevout.hash);
+        }
+        if (remove) {
+            removed.insert(block_tx.GetHash());
+            m_tx_index.erase(block_tx.GetHash());
+            m_removed.emplace_back(seq, block_tx.GetHash());
+            m_block_weight -= GetTransactionWeight(block_tx);
+            m_block_sigops_cost -= m_template->vTxSigOpsCost[i];
+            m_fees -= m_template->vTxFees[i];
+            continue;
+        }
+        m_tx_index[block_tx.GetHash()] = out;
+        block.vtx[out] = std::move(block.vtx[i]);
+        m_template->vTxFees[out] = m_template->vTxFees[i];
+        m_template->vTxSigOpsCost[out] = m_template->vTxSigOpsCost[i];
+        m_tx_seq[out] = m_tx_seq[i];
+        ++out;
+    }
+    block.vtx.resize(out);
+    m_template->vTxFees.resize(out);
+    m_template->vTxSigOpsCost.resize(out);
+    m_tx_seq.resize(out);
+    m_coinbase_dirty = true;
+}
@@ -8,11 +8,15 @@
 
 #include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <memory>
 #include <stdint.h>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -24,6 +28,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blockclusterselection */
+static const bool DEFAULT_BLOCK_CLUSTER_SELECTION = false;
+/** Minimum age in seconds of a stale template before it is rebuilt for the same tip */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 5;
 
 struct CBlockTemplate
 {
@@ -133,6 +141,8 @@ private:
     bool fIncludeWitness;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
+    bool m_cluster_selection;
+    bool m_test_block_validity;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
@@ -152,6 +162,14 @@ public:
         Options();
         size_t nBlockMaxWeight;
         CFeeRate blockMinFeeRate;
+        bool cluster_selection;
+        /**
+         * Check the block against the active chain: the lock times of its
+         * transactions and TestBlockValidity. Only to be turned off for a
+         * mempool that was not built on the active chain, such as a replayed
+         * trace.
+         */
+        bool test_block_validity;
     };
 
     explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params);
@@ -175,6 +193,9 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add transactions by merging the mempool's cluster chunks, best
+      * feerate first. Increments nPackagesSelected for every chunk added. */
+    void addClusterTxs(int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -186,6 +207,8 @@ private:
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Perform the checks of TestPackageTransactions on one transaction */
+    bool TestTransaction(const CTxMemPoolEntry& entry) const;
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set& mapModifiedTx, CTxMemPool::setEntries& failedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
@@ -197,6 +220,104 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/**
+ * Keeps a block template for the current tip ready to be served, so that
+ * getblocktemplate does not have to run CreateNewBlock() on every call.
+ *
+ * A full rebuild happens when the tip changes (eagerly, once a template has
+ * been requested at least once) and when the template went stale, i.e. the
+ * mempool changed in a way that could not be patched in, and it is older
+ * than BLOCK_TEMPLATE_REBUILD_INTERVAL. In between, transactions added to the
+ * mempool are appended to the template when all their unconfirmed parents
+ * are already part of it and they fit, and removed transactions are dropped
+ * from it together with their in-template descendants. Appending never
+ * reorders the template, so it stays valid but may pay less than a rebuild
+ * would; that is what makes it stale.
+ *
+ * Every state of the template has a TemplateId. Since patches only remove
+ * transactions and append new ones, a client that holds an earlier state of
+ * the same build can catch up from the list of removed txids and the
+ * transactions added after its state, see GetTemplate().
+ */
+class BlockTemplateManager final : public CValidationInterface
+{
+public:
+    /** Identifies one state of the maintained template */
+    struct TemplateId {
+        uint64_t build{0}; //!< Unique per full rebuild
+        uint64_t seq{0};   //!< Number of patches applied since that rebuild
+    };
+
+    /** A copy of the template as returned by GetTemplate() */
+    struct Snapshot {
+        CBlockTemplate block_template;
+        const CBlockIndex* prev{nullptr};
+        TemplateId id;
+        //! Mempool update counter the template was last synchronized with
+        unsigned int transactions_updated{0};
+        //! Whether `unchanged` and `removed` describe the changes since the requested state
+        bool delta{false};
+        //! Number of leading transactions (including the coinbase) that were already part of the requested state
+        size_t unchanged{0};
+        //! Txids removed since the requested state, possibly including transactions added after it
+        std::vector<uint256> removed;
+    };
+
+    BlockTemplateManager(CTxMemPool& mempool, const CChainParams& chainparams);
+
+    /**
+     * Return a copy of the current template, rebuilding it first if necessary.
+     * If `since` refers to an earlier state of the same build, the snapshot is
+     * a delta against it. Throws if the template cannot be created.
+     */
+    Snapshot GetTemplate(const TemplateId* since) LOCKS_EXCLUDED(m_mutex);
+
+    /** Force a rebuild once the template is old enough, e.g. after fee deltas changed */
+    void MarkStale() LOCKS_EXCLUDED(m_mutex);
+
+protected:
+    // CValidationInterface
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override;
+
+private:
+    void Rebuild() EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs, m_mutex);
+    /** Update the coinbase value and witness commitment after patches */
+    void UpdateCoinbase() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    const BlockAssembler::Options m_options;
+    const uint64_t m_block_max_weight;
+
+    Mutex m_mutex;
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    const CBlockIndex* m_prev GUARDED_BY(m_mutex){nullptr};
+    //! Set by the first request; until then no template is maintained
+    bool m_active GUARDED_BY(m_mutex){false};
+    bool m_stale GUARDED_BY(m_mutex){false};
+    bool m_coinbase_dirty GUARDED_BY(m_mutex){false};
+    int64_t m_build_time GUARDED_BY(m_mutex){0};
+    TemplateId m_id GUARDED_BY(m_mutex);
+    unsigned int m_transactions_updated GUARDED_BY(m_mutex){0};
+
+    // Block state of the template, as tracked by BlockAssembler
+    uint64_t m_block_weight GUARDED_BY(m_mutex){0};
+    int64_t m_block_sigops_cost GUARDED_BY(m_mutex){0};
+    CAmount m_fees GUARDED_BY(m_mutex){0};
+    CAmount m_subsidy GUARDED_BY(m_mutex){0};
+    int64_t m_lock_time_cutoff GUARDED_BY(m_mutex){0};
+    bool m_include_witness GUARDED_BY(m_mutex){false};
+
+    //! Position of every transaction in the block
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> m_tx_index GUARDED_BY(m_mutex);
+    //! Sequence number at which each transaction of the block was added, 0 for the rebuild
+    std::vector<uint64_t> m_tx_seq GUARDED_BY(m_mutex);
+    //! Transactions removed since the rebuild, with the sequence number of their removal
+    std::vector<std::pair<uint64_t, uint256>> m_removed GUARDED_BY(m_mutex);
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
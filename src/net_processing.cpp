@@ -488,6 +488,15 @@ struct Peer {
     /** Whether this peer should be disconnected and marked as discouraged (unless it has the noban permission). */
     bool m_should_discourage GUARDED_BY(m_misbehavior_mutex){false};
 
+    /** Protects the transaction validation queue */
+    Mutex m_tx_queue_mutex;
+    /** Transactions received from this peer that wait for a validation thread */
+    std::deque<CTransactionRef> m_tx_queue GUARDED_BY(m_tx_queue_mutex);
+    /** Whether this peer is scheduled for, or being served by, a validation thread */
+    bool m_tx_queue_scheduled GUARDED_BY(m_tx_queue_mutex){false};
+    /** Number of transactions received from this peer that have been validated */
+    uint64_t m_txs_processed GUARDED_BY(m_tx_queue_mutex){0};
+
     Peer(NodeId id) : m_id(id) {}
 };
 
@@ -907,6 +916,11 @@ void PeerManager::ReattemptInitialBroadcast(CScheduler& scheduler) const
     scheduler.scheduleFromNow([&] { ReattemptInitialBroadcast(scheduler); }, delta);
 }
 
+PeerManager::~PeerManager()
+{
+    StopTxValidation();
+}
+
 void PeerManager::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     fUpdateConnectionTime = false;
     LOCK(cs_main);
@@ -970,6 +984,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     PeerRef peer = GetPeerRef(nodeid);
     if (peer == nullptr) return false;
     stats.m_misbehavior_score = WITH_LOCK(peer->m_misbehavior_mutex, return peer->m_misbehavior_score);
+    {
+        LOCK(peer->m_tx_queue_mutex);
+        stats.m_txs_queued = peer->m_tx_queue.size();
+        stats.m_txs_processed = peer->m_txs_processed;
+    }
 
     return true;
 }
@@ -2106,6 +2125,279 @@ void PeerManager::ProcessOrphanTx(std::set<uint256>& orphan_work_set, std::list<
     }
 }
 
+void PeerManager::ProcessTransaction(CNode& pfrom, const CTransactionRef& ptx)
+{
+    const CTransaction& tx = *ptx;
+    const uint256& txid = ptx->GetHash();
+    const uint256& wtxid = ptx->GetWitnessHash();
+
+    TxValidationState state;
+    std::list<CTransactionRef> lRemovedTxn;
+
+    // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
+    // absence of witness malleation, this is strictly better, because the
+    // recent rejects filter may contain the wtxid but rarely contains
+    // the txid of a segwit transaction that has been rejected.
+    // In the presence of witness malleation, it's possible that by only
+    // doing the check with wtxid, we could overlook a transaction which
+    // was confirmed with a different witness, or exists in our mempool
+    // with a different witness, but this has limited downside:
+    // mempool validation does its own lookup of whether we have the txid
+    // already; and an adversary can already relay us old transactions
+    // (older than our recency filter) if trying to DoS us, without any need
+    // for witness malleation.
+    //
+    // Scripts are verified without holding cs_main, so that other peers'
+    // transactions and messages can be processed meanwhile.
+    const bool already_have = WITH_LOCK(cs_main, return AlreadyHaveTx(GenTxid(/* is_wtxid=*/true, wtxid), m_mempool));
+    const bool accepted = !already_have && AcceptToMemoryPoolConcurrent(m_mempool, state, ptx, &lRemovedTxn, 0 /* nAbsurdFee */);
+
+    LOCK2(cs_main, g_cs_orphans);
+    if (accepted) {
+        m_mempool.check(&::ChainstateActive().CoinsTip());
+        RelayTransaction(tx.GetHash(), tx.GetWitnessHash(), m_connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
+            if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                for (const auto& elem : it_by_prev->second) {
+                    pfrom.orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+
+        pfrom.nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom.GetId(),
+            tx.GetHash().ToString(),
+            m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTx(pfrom.orphan_work_set, lRemovedTxn);
+    }
+    else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+
+        // Deduplicate parent txids, so that we don't have to loop over
+        // the same parent txid more than once down below.
+        std::vector<uint256> unique_parents;
+        unique_parents.reserve(tx.vin.size());
+        for (const CTxIn& txin : tx.vin) {
+            // We start with all parents, and then remove duplicates below.
+            unique_parents.push_back(txin.prevout.hash);
+        }
+        std::sort(unique_parents.begin(), unique_parents.end());
+        unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
+        for (const uint256& parent_txid : unique_parents) {
+            if (recentRejects->contains(parent_txid)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            const auto current_time = GetTime<std::chrono::microseconds>();
+
+            for (const uint256& parent_txid : unique_parents) {
+                // Here, we only have the txid (and not wtxid) of the
+                // inputs, so we only request in txid mode, even for
+                // wtxidrelay peers.
+                // Eventually we should replace this with an improved
+                // protocol for getting all unconfirmed parents.
+                const GenTxid gtxid{/* is_wtxid=*/false, parent_txid};
+                pfrom.AddKnownTx(parent_txid);
+                if (!AlreadyHaveTx(gtxid, m_mempool)) RequestTx(State(pfrom.GetId()), gtxid, current_time);
+            }
+            AddOrphanTx(ptx, pfrom.GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            // Here we add both the txid and the wtxid, as we know that
+            // regardless of what witness is provided, we will not accept
+            // this, so we don't need to allow for redownload of this txid
+            // from any of our non-wtxidrelay peers.
+            recentRejects->insert(tx.GetHash());
+            recentRejects->insert(tx.GetWitnessHash());
+        }
+    } else {
+        if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
+            // We can add the wtxid of this transaction to our reject filter.
+            // Do not add txids of witness transactions or witness-stripped
+            // transactions to the filter, as they can have been malleated;
+            // adding such txids to the reject filter would potentially
+            // interfere with relay of valid transactions from peers that
+            // do not support wtxid-based relay. See
+            // https://github.com/synergy-promotions/baddcoin/issues/8279 for details.
+            // We can remove this restriction (and always add wtxids to
+            // the filter even for witness stripped transactions) once
+            // wtxid-based relay is broadly deployed.
+            // See also comments in https://github.com/synergy-promotions/baddcoin/pull/18044#discussion_r443419034
+            // for concerns around weakening security of unupgraded nodes
+            // if we start doing this too early.
+            assert(recentRejects);
+            recentRejects->insert(tx.GetWitnessHash());
+            // If the transaction failed for TX_INPUTS_NOT_STANDARD,
+            // then we know that the witness was irrelevant to the policy
+            // failure, since this check depends only on the txid
+            // (the scriptPubKey being spent is covered by the txid).
+            // Add the txid to the reject filter to prevent repeated
+            // processing of this transaction in the event that child
+            // transactions are later received (resulting in
+            // parent-fetching by txid via the orphan-handling logic).
+            if (state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD && tx.GetWitnessHash() != tx.GetHash()) {
+                recentRejects->insert(tx.GetHash());
+            }
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
+        }
+
+        if (pfrom.HasPermission(PF_FORCERELAY)) {
+            // Always relay transactions received from peers with forcerelay permission, even
+            // if they were already in the mempool,
+            // allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            if (!m_mempool.exists(tx.GetHash())) {
+                LogPrintf("Not relaying non-mempool transaction %s from forcerelay peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
+            } else {
+                LogPrintf("Force relaying tx %s from peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
+                RelayTransaction(tx.GetHash(), tx.GetWitnessHash(), m_connman);
+            }
+        }
+    }
+
+    for (const CTransactionRef& removedTx : lRemovedTxn)
+        AddToCompactExtraTransactions(removedTx);
+
+    // If a tx has been detected by recentRejects, we will have reached
+    // this point and the tx will have been ignored. Because we haven't run
+    // the tx through AcceptToMemoryPool, we won't have computed a DoS
+    // score for it or determined exactly why we consider it invalid.
+    //
+    // This means we won't penalize any peer subsequently relaying a DoSy
+    // tx (even if we penalized the first peer who gave it to us) because
+    // we have to account for recentRejects showing false positives. In
+    // other words, we shouldn't penalize a peer if we aren't *sure* they
+    // submitted a DoSy tx.
+    //
+    // Note that recentRejects doesn't just record DoSy or invalid
+    // transactions, but any tx not accepted by the mempool, which may be
+    // due to node policy (vs. consensus). So we can't blanket penalize a
+    // peer simply for relaying a tx that our recentRejects has caught,
+    // regardless of false positives.
+
+    if (state.IsInvalid()) {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+            pfrom.GetId(),
+            state.ToString());
+        MaybePunishNodeForTx(pfrom.GetId(), state);
+    }
+}
+
+void PeerManager::QueueTransaction(CNode& pfrom, const CTransactionRef& ptx)
+{
+    PeerRef peer = GetPeerRef(pfrom.GetId());
+    if (peer == nullptr) return;
+    {
+        LOCK(peer->m_tx_queue_mutex);
+        peer->m_tx_queue.push_back(ptx);
+        if (peer->m_tx_queue_scheduled) return;
+        peer->m_tx_queue_scheduled = true;
+    }
+    LOCK(m_tx_validation_mutex);
+    m_tx_validation_peers.push_back(pfrom.AddRef());
+    m_tx_validation_cv.notify_one();
+}
+
+void PeerManager::ThreadTxValidation(int worker_num)
+{
+    util::ThreadRename(strprintf("txval.%i", worker_num));
+    while (true) {
+        CNode* pnode;
+        {
+            WAIT_LOCK(m_tx_validation_mutex, lock);
+            m_tx_validation_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_tx_validation_mutex) { return m_tx_validation_stop || !m_tx_validation_peers.empty(); });
+            if (m_tx_validation_stop) return;
+            pnode = m_tx_validation_peers.front();
+            m_tx_validation_peers.pop_front();
+        }
+        // The reference we hold on the node keeps FinalizeNode from removing the peer
+        PeerRef peer = GetPeerRef(pnode->GetId());
+        assert(peer != nullptr);
+
+        // Validate one transaction for this peer, then let the next peer go
+        // first, so that a peer flooding us with transactions does not hold
+        // up the others.
+        const CTransactionRef ptx = WITH_LOCK(peer->m_tx_queue_mutex, return peer->m_tx_queue.front());
+        if (!pnode->fDisconnect) {
+            ProcessTransaction(*pnode, ptx);
+        }
+
+        bool more;
+        bool was_full;
+        {
+            LOCK(peer->m_tx_queue_mutex);
+            was_full = peer->m_tx_queue.size() >= MAX_PEER_TX_VALIDATION_QUEUE;
+            peer->m_tx_queue.pop_front();
+            ++peer->m_txs_processed;
+            more = !peer->m_tx_queue.empty();
+            peer->m_tx_queue_scheduled = more;
+        }
+        // The message handler skips peers with a full queue, see ProcessMessages()
+        if (was_full) m_connman.WakeMessageHandler();
+
+        if (more) {
+            LOCK(m_tx_validation_mutex);
+            m_tx_validation_peers.push_back(pnode);
+            m_tx_validation_cv.notify_one();
+        } else {
+            pnode->Release();
+        }
+    }
+}
+
+void PeerManager::StartTxValidation(int num_threads)
+{
+    assert(m_tx_validation_threads.empty());
+    WITH_LOCK(m_tx_validation_mutex, m_tx_validation_stop = false);
+    for (int i = 0; i < num_threads; ++i) {
+        m_tx_validation_threads.emplace_back(&PeerManager::ThreadTxValidation, this, i);
+    }
+}
+
+void PeerManager::StopTxValidation()
+{
+    WITH_LOCK(m_tx_validation_mutex, m_tx_validation_stop = true);
+    m_tx_validation_cv.notify_all();
+    for (std::thread& thread : m_tx_validation_threads) {
+        thread.join();
+    }
+    m_tx_validation_threads.clear();
+
+    LOCK(m_tx_validation_mutex);
+    for (CNode* pnode : m_tx_validation_peers) {
+        PeerRef peer = GetPeerRef(pnode->GetId());
+        assert(peer != nullptr);
+        {
+            LOCK(peer->m_tx_queue_mutex);
+            peer->m_tx_queue.clear();
+            peer->m_tx_queue_scheduled = false;
+        }
+        pnode->Release();
+    }
+    m_tx_validation_peers.clear();
+}
+
 /**
  * Validation logic for compact filters request handling.
  *
@@ -2957,197 +3249,37 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
 
         CTransactionRef ptx;
         vRecv >> ptx;
-        const CTransaction& tx = *ptx;
 
         const uint256& txid = ptx->GetHash();
         const uint256& wtxid = ptx->GetWitnessHash();
 
-        LOCK2(cs_main, g_cs_orphans);
-
-        CNodeState* nodestate = State(pfrom.GetId());
-
-        const uint256& hash = nodestate->m_wtxid_relay ? wtxid : txid;
-        pfrom.AddKnownTx(hash);
-        if (nodestate->m_wtxid_relay && txid != wtxid) {
-            // Insert txid into filterInventoryKnown, even for
-            // wtxidrelay peers. This prevents re-adding of
-            // unconfirmed parents to the recently_announced
-            // filter, when a child tx is requested. See
-            // ProcessGetData().
-            pfrom.AddKnownTx(txid);
-        }
-
-        TxValidationState state;
-
-        for (const GenTxid& gtxid : {GenTxid(false, txid), GenTxid(true, wtxid)}) {
-            nodestate->m_tx_download.m_tx_announced.erase(gtxid.GetHash());
-            nodestate->m_tx_download.m_tx_in_flight.erase(gtxid.GetHash());
-            EraseTxRequest(gtxid);
-        }
-
-        std::list<CTransactionRef> lRemovedTxn;
-
-        // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
-        // absence of witness malleation, this is strictly better, because the
-        // recent rejects filter may contain the wtxid but rarely contains
-        // the txid of a segwit transaction that has been rejected.
-        // In the presence of witness malleation, it's possible that by only
-        // doing the check with wtxid, we could overlook a transaction which
-        // was confirmed with a different witness, or exists in our mempool
-        // with a different witness, but this has limited downside:
-        // mempool validation does its own lookup of whether we have the txid
-        // already; and an adversary can already relay us old transactions
-        // (older than our recency filter) if trying to DoS us, without any need
-        // for witness malleation.
-        if (!AlreadyHaveTx(GenTxid(/* is_wtxid=*/true, wtxid), m_mempool) &&
-            AcceptToMemoryPool(m_mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            m_mempool.check(&::ChainstateActive().CoinsTip());
-            RelayTransaction(tx.GetHash(), tx.GetWitnessHash(), m_connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom.orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            pfrom.nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom.GetId(),
-                tx.GetHash().ToString(),
-                m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(pfrom.orphan_work_set, lRemovedTxn);
-        }
-        else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
         {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-
-            // Deduplicate parent txids, so that we don't have to loop over
-            // the same parent txid more than once down below.
-            std::vector<uint256> unique_parents;
-            unique_parents.reserve(tx.vin.size());
-            for (const CTxIn& txin : tx.vin) {
-                // We start with all parents, and then remove duplicates below.
-                unique_parents.push_back(txin.prevout.hash);
-            }
-            std::sort(unique_parents.begin(), unique_parents.end());
-            unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
-            for (const uint256& parent_txid : unique_parents) {
-                if (recentRejects->contains(parent_txid)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                const auto current_time = GetTime<std::chrono::microseconds>();
-
-                for (const uint256& parent_txid : unique_parents) {
-                    // Here, we only have the txid (and not wtxid) of the
-                    // inputs, so we only request in txid mode, even for
-                    // wtxidrelay peers.
-                    // Eventually we should replace this with an improved
-                    // protocol for getting all unconfirmed parents.
-                    const GenTxid gtxid{/* is_wtxid=*/false, parent_txid};
-                    pfrom.AddKnownTx(parent_txid);
-                    if (!AlreadyHaveTx(gtxid, m_mempool)) RequestTx(State(pfrom.GetId()), gtxid, current_time);
-                }
-                AddOrphanTx(ptx, pfrom.GetId());
+            LOCK(cs_main);
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                // Here we add both the txid and the wtxid, as we know that
-                // regardless of what witness is provided, we will not accept
-                // this, so we don't need to allow for redownload of this txid
-                // from any of our non-wtxidrelay peers.
-                recentRejects->insert(tx.GetHash());
-                recentRejects->insert(tx.GetWitnessHash());
-            }
-        } else {
-            if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
-                // We can add the wtxid of this transaction to our reject filter.
-                // Do not add txids of witness transactions or witness-stripped
-                // transactions to the filter, as they can have been malleated;
-                // adding such txids to the reject filter would potentially
-                // interfere with relay of valid transactions from peers that
-                // do not support wtxid-based relay. See
-                // https://github.com/synergy-promotions/baddcoin/issues/8279 for details.
-                // We can remove this restriction (and always add wtxids to
-                // the filter even for witness stripped transactions) once
-                // wtxid-based relay is broadly deployed.
-                // See also comments in https://github.com/synergy-promotions/baddcoin/pull/18044#discussion_r443419034
-                // for concerns around weakening security of unupgraded nodes
-                // if we start doing this too early.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetWitnessHash());
-                // If the transaction failed for TX_INPUTS_NOT_STANDARD,
-                // then we know that the witness was irrelevant to the policy
-                // failure, since this check depends only on the txid
-                // (the scriptPubKey being spent is covered by the txid).
-                // Add the txid to the reject filter to prevent repeated
-                // processing of this transaction in the event that child
-                // transactions are later received (resulting in
-                // parent-fetching by txid via the orphan-handling logic).
-                if (state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD && tx.GetWitnessHash() != tx.GetHash()) {
-                    recentRejects->insert(tx.GetHash());
-                }
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
+            CNodeState* nodestate = State(pfrom.GetId());
+
+            const uint256& hash = nodestate->m_wtxid_relay ? wtxid : txid;
+            pfrom.AddKnownTx(hash);
+            if (nodestate->m_wtxid_relay && txid != wtxid) {
+                // Insert txid into filterInventoryKnown, even for
+                // wtxidrelay peers. This prevents re-adding of
+                // unconfirmed parents to the recently_announced
+                // filter, when a child tx is requested. See
+                // ProcessGetData().
+                pfrom.AddKnownTx(txid);
             }
 
-            if (pfrom.HasPermission(PF_FORCERELAY)) {
-                // Always relay transactions received from peers with forcerelay permission, even
-                // if they were already in the mempool,
-                // allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                if (!m_mempool.exists(tx.GetHash())) {
-                    LogPrintf("Not relaying non-mempool transaction %s from forcerelay peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
-                } else {
-                    LogPrintf("Force relaying tx %s from peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
-                    RelayTransaction(tx.GetHash(), tx.GetWitnessHash(), m_connman);
-                }
+            for (const GenTxid& gtxid : {GenTxid(false, txid), GenTxid(true, wtxid)}) {
+                nodestate->m_tx_download.m_tx_announced.erase(gtxid.GetHash());
+                nodestate->m_tx_download.m_tx_in_flight.erase(gtxid.GetHash());
+                EraseTxRequest(gtxid);
             }
         }
 
-        for (const CTransactionRef& removedTx : lRemovedTxn)
-            AddToCompactExtraTransactions(removedTx);
-
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        if (state.IsInvalid()) {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom.GetId(),
-                state.ToString());
-            MaybePunishNodeForTx(pfrom.GetId(), state);
+        if (m_tx_validation_threads.empty()) {
+            ProcessTransaction(pfrom, ptx);
+        } else {
+            QueueTransaction(pfrom, ptx);
         }
         return;
     }
@@ -3837,7 +3969,8 @@ bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgP
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(*pfrom, m_chainparams, m_connman, m_mempool, interruptMsgProc);
 
-    if (!pfrom->orphan_work_set.empty()) {
+    // The transaction validation threads add to orphan_work_set as well
+    if (WITH_LOCK(g_cs_orphans, return !pfrom->orphan_work_set.empty())) {
         std::list<CTransactionRef> removed_txn;
         LOCK2(cs_main, g_cs_orphans);
         ProcessOrphanTx(pfrom->orphan_work_set, removed_txn);
@@ -3852,12 +3985,18 @@ bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgP
     // this maintains the order of responses
     // and prevents vRecvGetData to grow unbounded
     if (!pfrom->vRecvGetData.empty()) return true;
-    if (!pfrom->orphan_work_set.empty()) return true;
+    if (WITH_LOCK(g_cs_orphans, return !pfrom->orphan_work_set.empty())) return true;
 
     // Don't bother if send buffer is too full to respond anyway
     if (pfrom->fPauseSend)
         return false;
 
+    // Don't take more transactions until the validation threads caught up
+    // with this peer; they wake us up once its queue has room again
+    PeerRef peer = GetPeerRef(pfrom->GetId());
+    if (peer && WITH_LOCK(peer->m_tx_queue_mutex, return peer->m_tx_queue.size()) >= MAX_PEER_TX_VALIDATION_QUEUE)
+        return false;
+
     std::list<CNetMessage> msgs;
     {
         LOCK(pfrom->cs_vProcessMsg);
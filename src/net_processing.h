@@ -11,6 +11,11 @@
 #include <sync.h>
 #include <validationinterface.h>
 
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
 class BlockTransactionsRequest;
 class BlockValidationState;
 class CBlockHeader;
@@ -30,11 +35,26 @@ static const bool DEFAULT_PEERBLOOMFILTERS = false;
 static const bool DEFAULT_PEERBLOCKFILTERS = false;
 /** Threshold for marking a node to be discouraged, e.g. disconnected and added to the discouragement filter. */
 static const int DISCOURAGEMENT_THRESHOLD{100};
+/** Default for -txvalidationthreads, the number of threads validating transactions received from peers */
+static const int DEFAULT_TX_VALIDATION_THREADS = 2;
+/** Maximum number of transaction validation threads */
+static const int MAX_TX_VALIDATION_THREADS = 16;
+/** Maximum number of transactions a peer can have waiting for validation before we stop processing its messages */
+static const size_t MAX_PEER_TX_VALIDATION_QUEUE = 100;
 
 class PeerManager final : public CValidationInterface, public NetEventsInterface {
 public:
     PeerManager(const CChainParams& chainparams, CConnman& connman, BanMan* banman,
                 CScheduler& scheduler, ChainstateManager& chainman, CTxMemPool& pool);
+    ~PeerManager();
+
+    /**
+     * Start threads validating the transactions received from peers. Without
+     * them, transactions are validated on the message handler thread.
+     */
+    void StartTxValidation(int num_threads);
+    /** Stop the transaction validation threads and drop the transactions still queued */
+    void StopTxValidation();
 
     /**
      * Overridden from CValidationInterface.
@@ -123,6 +143,12 @@ private:
 
     void ProcessOrphanTx(std::set<uint256>& orphan_work_set, std::list<CTransactionRef>& removed_txn)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+    /** Validate a transaction received from a peer and relay it, process its orphans or punish the peer */
+    void ProcessTransaction(CNode& pfrom, const CTransactionRef& ptx) LOCKS_EXCLUDED(cs_main, g_cs_orphans);
+    /** Queue a transaction received from a peer for the validation threads */
+    void QueueTransaction(CNode& pfrom, const CTransactionRef& ptx);
+    /** Body of a transaction validation thread: serve peers with queued transactions in turn */
+    void ThreadTxValidation(int worker_num);
     /** Process a single headers message from a peer. */
     void ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block);
 
@@ -136,10 +162,24 @@ private:
     CTxMemPool& m_mempool;
 
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
+
+    Mutex m_tx_validation_mutex;
+    std::condition_variable m_tx_validation_cv;
+    /**
+     * Peers with queued transactions, served one transaction at a time in
+     * round-robin order. Each entry holds a reference on the peer's CNode.
+     * A peer is either in here or being served by exactly one thread, so
+     * that its transactions are validated in the order they were received.
+     */
+    std::deque<CNode*> m_tx_validation_peers GUARDED_BY(m_tx_validation_mutex);
+    bool m_tx_validation_stop GUARDED_BY(m_tx_validation_mutex){false};
+    std::vector<std::thread> m_tx_validation_threads;
 };
 
 struct CNodeStateStats {
     int m_misbehavior_score = 0;
+    size_t m_txs_queued = 0;
+    uint64_t m_txs_processed = 0;
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
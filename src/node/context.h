@@ -12,10 +12,12 @@
 
 class ArgsManager;
 class BanMan;
+class BlockTemplateManager;
 class CConnman;
 class CScheduler;
 class CTxMemPool;
 class ChainstateManager;
+class MempoolTraceRecorder;
 class PeerManager;
 namespace interfaces {
 class Chain;
@@ -37,6 +39,8 @@ struct NodeContext {
     std::unique_ptr<CConnman> connman;
     std::unique_ptr<CTxMemPool> mempool;
     std::unique_ptr<PeerManager> peerman;
+    std::unique_ptr<BlockTemplateManager> block_template_manager;
+    std::unique_ptr<MempoolTraceRecorder> mempool_trace_recorder;
     ChainstateManager* chainman{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
     std::unique_ptr<BanMan> banman;
     ArgsManager* args{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
@@ -0,0 +1,115 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/mempool_trace.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <primitives/block.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <stdexcept>
+
+MempoolTraceRecorder::MempoolTraceRecorder(const CTxMemPool& mempool, const fs::path& path)
+    : m_mempool(mempool), m_file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION)
+{
+    LOCK(m_mutex);
+    if (m_file.IsNull()) {
+        LogPrintf("Failed to open mempool trace file %s\n", path.string());
+        return;
+    }
+    try {
+        m_file << MEMPOOL_TRACE_VERSION << Params().NetworkIDString();
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to write mempool trace: %s\n", e.what());
+        m_file.fclose();
+        return;
+    }
+    LogPrintf("Recording mempool trace to %s\n", path.string());
+}
+
+bool MempoolTraceRecorder::IsRecording() const
+{
+    LOCK(m_mutex);
+    return !m_file.IsNull();
+}
+
+void MempoolTraceRecorder::Write(const MempoolTraceRecord& record)
+{
+    LOCK(m_mutex);
+    if (m_file.IsNull()) return;
+    try {
+        m_file << record;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to write mempool trace, stopped recording: %s\n", e.what());
+        m_file.fclose();
+    }
+}
+
+void MempoolTraceRecorder::TransactionAddedToMempool(const CTransactionRef& tx)
+{
+    MempoolTraceRecord record;
+    record.type = MempoolTraceRecord::ADD;
+    record.time = GetTimeMicros();
+    record.tx = tx;
+    {
+        LOCK(m_mempool.cs);
+        auto it = m_mempool.GetIter(tx->GetHash());
+        if (!it) return;
+        record.fee = (*it)->GetFee();
+        record.sigop_cost = (*it)->GetSigOpCost();
+        record.entry_height = (*it)->GetHeight();
+        record.spends_coinbase = (*it)->GetSpendsCoinbase();
+    }
+    Write(record);
+}
+
+void MempoolTraceRecorder::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason)
+{
+    MempoolTraceRecord record;
+    record.type = MempoolTraceRecord::REMOVE;
+    record.time = GetTimeMicros();
+    record.txid = tx->GetHash();
+    record.reason = static_cast<uint8_t>(reason);
+    Write(record);
+}
+
+void MempoolTraceRecorder::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    MempoolTraceRecord record;
+    record.type = MempoolTraceRecord::BLOCK;
+    record.time = GetTimeMicros();
+    record.height = pindex->nHeight;
+    record.block_txs.assign(block->vtx.begin() + 1, block->vtx.end());
+    Write(record);
+}
+
+MempoolTraceReader::MempoolTraceReader(const fs::path& path)
+    : m_file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION)
+{
+    if (m_file.IsNull()) {
+        throw std::runtime_error(strprintf("Cannot open mempool trace %s", path.string()));
+    }
+    uint64_t version;
+    m_file >> version;
+    if (version != MEMPOOL_TRACE_VERSION) {
+        throw std::runtime_error(strprintf("Unsupported mempool trace version %d", version));
+    }
+    m_file >> m_chain;
+}
+
+bool MempoolTraceReader::Next(MempoolTraceRecord& record)
+{
+    try {
+        m_file >> record;
+    } catch (const std::ios_base::failure&) {
+        if (feof(m_file.Get())) return false;
+        throw;
+    }
+    return true;
+}
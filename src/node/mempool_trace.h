@@ -0,0 +1,128 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BADDCOIN_NODE_MEMPOOL_TRACE_H
+#define BADDCOIN_NODE_MEMPOOL_TRACE_H
+
+#include <amount.h>
+#include <fs.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <streams.h>
+#include <sync.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <cstdint>
+#include <ios>
+#include <string>
+#include <vector>
+
+class CTxMemPool;
+
+/** Version of the trace format written by MempoolTraceRecorder */
+static constexpr uint64_t MEMPOOL_TRACE_VERSION{1};
+
+/**
+ * One event of a mempool trace. A trace file starts with MEMPOOL_TRACE_VERSION
+ * and the name of the chain it was recorded on, followed by the records in
+ * the order their notifications were handled.
+ */
+struct MempoolTraceRecord {
+    enum Type : uint8_t {
+        ADD = 0,    //!< A transaction entered the mempool
+        REMOVE = 1, //!< A transaction left the mempool
+        BLOCK = 2,  //!< A block was connected
+    };
+
+    uint8_t type{ADD};
+    //! When the notification was handled, in microseconds since the epoch
+    int64_t time{0};
+
+    //! ADD: the transaction and the data of its mempool entry
+    CTransactionRef tx;
+    CAmount fee{0};
+    int64_t sigop_cost{0};
+    uint32_t entry_height{0};
+    bool spends_coinbase{false};
+
+    //! REMOVE: the removed transaction and the MemPoolRemovalReason
+    uint256 txid;
+    uint8_t reason{0};
+
+    //! BLOCK: the height of the block and its transactions except the coinbase
+    int32_t height{0};
+    std::vector<CTransactionRef> block_txs;
+
+    SERIALIZE_METHODS(MempoolTraceRecord, obj)
+    {
+        READWRITE(obj.type, obj.time);
+        switch (obj.type) {
+        case ADD:
+            READWRITE(obj.tx, obj.fee, obj.sigop_cost, obj.entry_height, obj.spends_coinbase);
+            break;
+        case REMOVE:
+            READWRITE(obj.txid, obj.reason);
+            break;
+        case BLOCK:
+            READWRITE(obj.height, obj.block_txs);
+            break;
+        default:
+            throw std::ios_base::failure("Unknown mempool trace record type");
+        }
+    }
+};
+
+/**
+ * Validation interface client that writes the mempool and block events it
+ * is notified of to a trace file (-mempooltrace), so that real sessions can
+ * be replayed offline with bench_baddcoin -mempooltrace. A transaction that
+ * has left the mempool again by the time its notification is handled is not
+ * recorded.
+ */
+class MempoolTraceRecorder final : public CValidationInterface
+{
+public:
+    /** Start a new trace at path, replacing any file there */
+    MempoolTraceRecorder(const CTxMemPool& mempool, const fs::path& path);
+
+    /** Whether the trace is being written; false if the file could not be opened or written */
+    bool IsRecording() const LOCKS_EXCLUDED(m_mutex);
+
+protected:
+    // CValidationInterface
+    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override;
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override;
+
+private:
+    void Write(const MempoolTraceRecord& record) LOCKS_EXCLUDED(m_mutex);
+
+    const CTxMemPool& m_mempool;
+    mutable Mutex m_mutex;
+    CAutoFile m_file GUARDED_BY(m_mutex);
+};
+
+/** Reads a trace written by MempoolTraceRecorder */
+class MempoolTraceReader
+{
+public:
+    /** Open a trace. Throws std::runtime_error if it cannot be opened or has another version. */
+    explicit MempoolTraceReader(const fs::path& path);
+
+    /** The chain the trace was recorded on */
+    const std::string& GetChain() const { return m_chain; }
+
+    /**
+     * Read the next record. Returns false at the end of the trace, including
+     * a record cut short by a crash. Throws on corrupt records.
+     */
+    bool Next(MempoolTraceRecord& record);
+
+private:
+    CAutoFile m_file;
+    std::string m_chain;
+};
+
+#endif // BADDCOIN_NODE_MEMPOOL_TRACE_H
@@ -10,8 +10,18 @@
 #include <txmempool.h>
 #include <util/system.h>
 
+#include <tuple>
+
 static constexpr double INF_FEERATE = 1e99;
 
+/** Multiply every moving average in a (nested) vector by factor. */
+static void ScaleAverages(double& val, double factor) { val *= factor; }
+template <typename T>
+static void ScaleAverages(std::vector<T>& vals, double factor)
+{
+    for (T& val : vals) ScaleAverages(val, factor);
+}
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -65,15 +75,33 @@ private:
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
+    // The moving averages above are stored divided by the product of the
+    // decays applied since they were last rescaled, so that decaying them
+    // for a new block only updates this factor. See UpdateMovingAverages().
+    double m_decay_factor{1};
+    // Rescale the stored averages once the factor gets this small
+    static constexpr double MIN_DECAY_FACTOR = 1e-100;
+
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
     std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
+    // For each bucket X, the sum of unconfTxs[Y][X] over all Y
+    std::vector<int> unconfTotal;
+
+    // Results of EstimateMedianVal, keyed by its arguments, until the data
+    // they were computed from changes. Transactions entering the mempool
+    // don't invalidate them, as estimates never count the current block.
+    typedef std::tuple<int, double, double, bool, unsigned int> EstimateKey;
+    mutable std::map<EstimateKey, std::pair<double, EstimationResult>> m_estimates;
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Multiply the stored averages by the decay factor and reset it to 1 */
+    void Rescale();
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -166,6 +194,16 @@ void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
         unconfTxs[i].resize(newbuckets);
     }
     oldUnconfTxs.resize(newbuckets);
+    unconfTotal.resize(newbuckets);
+}
+
+void TxConfirmStats::Rescale()
+{
+    ScaleAverages(txCtAvg, m_decay_factor);
+    ScaleAverages(confAvg, m_decay_factor);
+    ScaleAverages(failAvg, m_decay_factor);
+    ScaleAverages(avg, m_decay_factor);
+    m_decay_factor = 1;
 }
 
 // Roll the unconfirmed txs circular buffer
@@ -173,8 +211,10 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
         oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
+        unconfTotal[j] -= unconfTxs[nBlockHeight%unconfTxs.size()][j];
         unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
     }
+    m_estimates.clear();
 }
 
 
@@ -185,23 +225,24 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    const double weight = 1 / m_decay_factor;
     for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+        confAvg[i - 1][bucketindex] += weight;
     }
-    txCtAvg[bucketindex]++;
-    avg[bucketindex] += val;
+    txCtAvg[bucketindex] += weight;
+    avg[bucketindex] += val * weight;
+    m_estimates.clear();
 }
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
+    // Instead of multiplying every average by the decay, weigh the data
+    // added from now on more heavily.
+    m_decay_factor *= decay;
+    if (m_decay_factor < MIN_DECAY_FACTOR) {
+        Rescale();
     }
+    m_estimates.clear();
 }
 
 // returns -1 on error conditions
@@ -209,6 +250,13 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
                                          unsigned int nBlockHeight, EstimationResult *result) const
 {
+    const EstimateKey key{confTarget, sufficientTxVal, successBreakPoint, requireGreater, nBlockHeight};
+    auto cached = m_estimates.find(key);
+    if (cached != m_estimates.end()) {
+        if (result) *result = cached->second.second;
+        return cached->second.first;
+    }
+
     // Counters for a bucket (or range of buckets)
     double nConf = 0; // Number of tx's confirmed within the confTarget
     double totalNum = 0; // Total number of tx's that were ever confirmed
@@ -249,12 +297,14 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
-        extraNum += oldUnconfTxs[bucket];
+        nConf += confAvg[periodTarget - 1][bucket] * m_decay_factor;
+        totalNum += txCtAvg[bucket] * m_decay_factor;
+        failNum += failAvg[periodTarget - 1][bucket] * m_decay_factor;
+        // Count the txs unconfirmed for confTarget or longer as all
+        // unconfirmed txs minus those that entered in the last confTarget blocks
+        extraNum += unconfTotal[bucket] + oldUnconfTxs[bucket];
+        for (unsigned int confct = 0; confct < (unsigned int)confTarget && confct < bins; confct++)
+            extraNum -= unconfTxs[(nBlockHeight + bins - confct)%bins][bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
         // (Only count the confirmed data points, so that each confirmation count
@@ -348,23 +398,33 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
              failBucket.withinTarget, failBucket.totalConfirmed, failBucket.inMempool, failBucket.leftMempool);
 
 
-    if (result) {
-        result->pass = passBucket;
-        result->fail = failBucket;
-        result->decay = decay;
-        result->scale = scale;
-    }
+    EstimationResult estimate;
+    estimate.pass = passBucket;
+    estimate.fail = failBucket;
+    estimate.decay = decay;
+    estimate.scale = scale;
+    m_estimates.emplace(key, std::make_pair(median, estimate));
+    if (result) *result = estimate;
     return median;
 }
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    // The file holds the averages themselves, not the values we store
+    std::vector<double> scaledAvg = avg;
+    std::vector<double> scaledTxCtAvg = txCtAvg;
+    std::vector<std::vector<double>> scaledConfAvg = confAvg;
+    std::vector<std::vector<double>> scaledFailAvg = failAvg;
+    ScaleAverages(scaledAvg, m_decay_factor);
+    ScaleAverages(scaledTxCtAvg, m_decay_factor);
+    ScaleAverages(scaledConfAvg, m_decay_factor);
+    ScaleAverages(scaledFailAvg, m_decay_factor);
     fileout << decay;
     fileout << scale;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << scaledAvg;
+    fileout << scaledTxCtAvg;
+    fileout << scaledConfAvg;
+    fileout << scaledFailAvg;
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -418,6 +478,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
+    m_decay_factor = 1;
+    m_estimates.clear();
 
     LogPrint(BCLog::ESTIMATEFEE, "Reading estimates: %u buckets counting confirms up to %u blocks\n",
              numBuckets, maxConfirms);
@@ -428,6 +490,7 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
+    unconfTotal[bucketindex]++;
     return bucketindex;
 }
 
@@ -454,6 +517,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         unsigned int blockIndex = entryHeight % unconfTxs.size();
         if (unconfTxs[blockIndex][bucketindex] > 0) {
             unconfTxs[blockIndex][bucketindex]--;
+            unconfTotal[bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -463,9 +527,11 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+            failAvg[i][bucketindex] += 1 / m_decay_factor;
         }
     }
+    // A tx from the current block is not counted by any estimate
+    if (blocksAgo != 0) m_estimates.clear();
 }
 
 // This function is called from CTxMemPool::removeUnchecked to ensure
@@ -488,6 +554,26 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     }
 }
 
+/**
+ * The feerate a transaction is mined at. A transaction with unconfirmed
+ * ancestors cannot be mined before them, so it is held back to the feerate
+ * of its ancestor package if that is lower. A transaction whose descendants
+ * pay more is mined along with them (child-pays-for-parent), so it is
+ * raised to the feerate of its descendant package. Package fees include
+ * prioritisation, unlike the transaction's own fee.
+ */
+static CFeeRate GetPackageFeeRate(const CTxMemPoolEntry& entry)
+{
+    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+    if (entry.GetCountWithDescendants() > 1) {
+        feeRate = std::max(feeRate, CFeeRate(entry.GetModFeesWithDescendants(), entry.GetSizeWithDescendants()));
+    }
+    if (entry.GetCountWithAncestors() > 1) {
+        feeRate = std::min(feeRate, CFeeRate(entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors()));
+    }
+    return feeRate;
+}
+
 CBlockPolicyEstimator::CBlockPolicyEstimator()
     : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
 {
@@ -538,7 +624,7 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     trackedTxs++;
 
     // Feerates are stored and reported as BADD-per-kb:
-    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+    CFeeRate feeRate = GetPackageFeeRate(entry);
 
     mapMemPoolTxs[hash].blockHeight = txHeight;
     unsigned int bucketIndex = feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
@@ -568,7 +654,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     }
 
     // Feerates are stored and reported as BADD-per-kb:
-    CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
+    CFeeRate feeRate = GetPackageFeeRate(*entry);
 
     feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
@@ -117,6 +117,11 @@ struct FeeCalculation
  * we've seen in that feerate bucket when calculating an estimate for any number
  * of confirmations below the number of blocks they've been outstanding.
  *
+ * Transactions are bucketed by the feerate they are mined at: a transaction
+ * that depends on unconfirmed transactions counts at no more than the feerate
+ * of that package, and one whose descendants pay more counts at the feerate
+ * of the package it forms with them.
+ *
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
  * stats on the transactions included in that block
@@ -181,7 +186,7 @@ public:
     void processBlock(unsigned int nBlockHeight,
                       std::vector<const CTxMemPoolEntry*>& entries);
 
-    /** Process a transaction accepted to the mempool*/
+    /** Process a transaction accepted to the mempool, once its ancestors are accounted for */
     void processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate);
 
     /** Remove a transaction from the mempool tracking stats*/
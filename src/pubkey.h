@@ -191,6 +191,13 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    /**
+     * Verify several DER signatures made with this key, parsing (and for a
+     * compressed key, decompressing) it only once. Returns whether each
+     * checks[i].second is a valid signature of *checks[i].first.
+     */
+    std::vector<bool> VerifyMany(const std::vector<std::pair<const uint256*, const std::vector<unsigned char>*>>& checks) const;
+
     /**
      * Check whether a signature is normalized (lower-S).
      */
@@ -1022,6 +1022,70 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue getcoinscacheinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcoinscacheinfo",
+                "\nReturns statistics about the in-memory cache of the unspent transaction output set and its last write to disk.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "coins", "The number of cached coins"},
+                        {RPCResult::Type::NUM, "usage", "Memory usage of the cache in bytes"},
+                        {RPCResult::Type::NUM, "max_usage", "Memory the cache may use in bytes, not counting unused mempool memory (see -dbcache)"},
+                        {RPCResult::Type::NUM, "retain", "Percentage of max_usage kept when the cache is written to disk (see -dbcacheretain)"},
+                        {RPCResult::Type::NUM, "hitrate", "Fraction of coin lookups served by the cache since the last write"},
+                        {RPCResult::Type::NUM, "pending", "The number of coins still being written to disk in the background"},
+                        {RPCResult::Type::OBJ, "lastflush", /* optional */ true, "The last write of the cache to disk, if any",
+                        {
+                            {RPCResult::Type::NUM_TIME, "time", "The time the write finished, expressed in " + UNIX_EPOCH_TIME},
+                            {RPCResult::Type::NUM, "duration", "Seconds block connection was held up by the write, not counting the background part"},
+                            {RPCResult::Type::BOOL, "partial", "Whether coins were kept in the cache"},
+                            {RPCResult::Type::NUM, "coins_before", "The number of cached coins before the write"},
+                            {RPCResult::Type::NUM, "coins_after", "The number of cached coins after the write"},
+                            {RPCResult::Type::NUM, "usage_before", "Memory usage of the cache before the write"},
+                            {RPCResult::Type::NUM, "usage_after", "Memory usage of the cache after the write"},
+                            {RPCResult::Type::NUM, "hitrate", "Fraction of coin lookups served by the cache between the write before and this one"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+                },
+            }.Check(request);
+
+    const auto hit_rate = [](uint64_t hits, uint64_t misses) {
+        return hits + misses == 0 ? 0.0 : (double)hits / (hits + misses);
+    };
+
+    LOCK(cs_main);
+    CChainState& chainstate = ::ChainstateActive();
+    const CCoinsViewCache& tip = chainstate.CoinsTip();
+    const CoinsFlushStats& flush = chainstate.m_last_coins_flush;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins", (uint64_t)tip.GetCacheSize());
+    ret.pushKV("usage", (uint64_t)tip.DynamicMemoryUsage());
+    ret.pushKV("max_usage", (uint64_t)chainstate.m_coinstip_cache_size_bytes);
+    ret.pushKV("retain", g_dbcache_retain);
+    ret.pushKV("hitrate", hit_rate(tip.GetCacheHits() - std::min(flush.hits_total, tip.GetCacheHits()),
+                                   tip.GetCacheMisses() - std::min(flush.misses_total, tip.GetCacheMisses())));
+    ret.pushKV("pending", (uint64_t)chainstate.CoinsWriter().GetPendingCount());
+    if (flush.time != 0) {
+        UniValue last(UniValue::VOBJ);
+        last.pushKV("time", flush.time);
+        last.pushKV("duration", flush.duration * 0.000001);
+        last.pushKV("partial", flush.partial);
+        last.pushKV("coins_before", (uint64_t)flush.coins_before);
+        last.pushKV("coins_after", (uint64_t)flush.coins_after);
+        last.pushKV("usage_before", (uint64_t)flush.usage_before);
+        last.pushKV("usage_after", (uint64_t)flush.usage_after);
+        last.pushKV("hitrate", hit_rate(flush.hits, flush.misses));
+        ret.pushKV("lastflush", last);
+    }
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxout",
@@ -1415,7 +1479,9 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool)
     ret.pushKV("loaded", pool.IsLoaded());
     ret.pushKV("size", (int64_t)pool.size());
     ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
+    const size_t usage = pool.DynamicMemoryUsage();
+    ret.pushKV("usage", (int64_t)usage);
+    ret.pushKV("usage_per_tx", (int64_t)(pool.size() ? usage / pool.size() : 0));
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
@@ -1436,6 +1502,7 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "size", "Current tx count"},
                         {RPCResult::Type::NUM, "bytes", "Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted"},
                         {RPCResult::Type::NUM, "usage", "Total memory usage for the mempool"},
+                        {RPCResult::Type::NUM, "usage_per_tx", "Average memory usage per transaction in the mempool, including the transaction itself"},
                         {RPCResult::Type::NUM, "maxmempool", "Maximum memory usage for the mempool"},
                         {RPCResult::Type::STR_AMOUNT, "mempoolminfee", "Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee"},
                         {RPCResult::Type::STR_AMOUNT, "minrelaytxfee", "Current minimum relay fee for transactions"},
@@ -2394,6 +2461,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      {} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
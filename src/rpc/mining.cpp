@@ -473,6 +473,8 @@ static RPCHelpMan prioritisetransaction()
     }
 
     EnsureMemPool(request.context).PrioritiseTransaction(hash, nAmount);
+    NodeContext& node = EnsureNodeContext(request.context);
+    if (node.block_template_manager) node.block_template_manager->MarkStale();
     return true;
 },
     };
@@ -507,6 +509,28 @@ static std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+static BlockTemplateManager& EnsureBlockTemplateManager(const util::Ref& context)
+{
+    NodeContext& node = EnsureNodeContext(context);
+    if (!node.block_template_manager) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block template manager not found");
+    }
+    return *node.block_template_manager;
+}
+
+static std::string TemplateIdToString(const BlockTemplateManager::TemplateId& id)
+{
+    return strprintf("%016x%016x", id.build, id.seq);
+}
+
+static bool ParseTemplateId(const std::string& str, BlockTemplateManager::TemplateId& id)
+{
+    if (str.size() != 32 || !IsHex(str)) return false;
+    id.build = std::stoull(str.substr(0, 16), nullptr, 16);
+    id.seq = std::stoull(str.substr(16), nullptr, 16);
+    return true;
+}
+
 static RPCHelpMan getblocktemplate()
 {
     return RPCHelpMan{"getblocktemplate",
@@ -532,6 +556,7 @@ static RPCHelpMan getblocktemplate()
                                     {"str", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "other client side supported softfork deployment"},
                                 },
                                 },
+                            {"since", RPCArg::Type::STR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "The templateid of an earlier response. If the template was only patched since then, the response only lists the transactions added since, together with the removed ones"},
                         },
                         "\"template_request\""},
                 },
@@ -549,7 +574,12 @@ static RPCHelpMan getblocktemplate()
                             }},
                         {RPCResult::Type::NUM, "vbrequired", "bit mask of versionbits the server requires set in submissions"},
                         {RPCResult::Type::STR, "previousblockhash", "The hash of current highest block"},
-                        {RPCResult::Type::ARR, "transactions", "contents of non-coinbase transactions that should be included in the next block",
+                        {RPCResult::Type::STR_HEX, "templateid", "an id to pass as 'since' to request only the changes to this template"},
+                        {RPCResult::Type::ARR, "removed", /* optional */ true, "only present if 'since' was accepted: txids removed from the template since then, possibly including transactions added after it",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                            }},
+                        {RPCResult::Type::ARR, "transactions", "contents of non-coinbase transactions that should be included in the next block. If 'since' was accepted, only the transactions added since then; they follow the remaining earlier ones, and 'depends' indexes the complete list",
                             {
                                 {RPCResult::Type::OBJ, "", "",
                                     {
@@ -598,6 +628,8 @@ static RPCHelpMan getblocktemplate()
     UniValue lpval = NullUniValue;
     std::set<std::string> setClientRules;
     int64_t nMaxVersionPreVB = -1;
+    BlockTemplateManager::TemplateId since;
+    bool has_since = false;
     if (!request.params[0].isNull())
     {
         const UniValue& oparam = request.params[0].get_obj();
@@ -611,6 +643,13 @@ static RPCHelpMan getblocktemplate()
         else
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
         lpval = find_value(oparam, "longpollid");
+        const UniValue& sinceval = find_value(oparam, "since");
+        if (!sinceval.isNull()) {
+            if (!sinceval.isStr() || !ParseTemplateId(sinceval.get_str(), since)) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid since");
+            }
+            has_since = true;
+        }
 
         if (strMode == "proposal")
         {
@@ -724,32 +763,14 @@ static RPCHelpMan getblocktemplate()
       //  throw JSONRPCError(RPC_INVALID_PARAMETER, "getblocktemplate must be called with the segwit rule set (call with {\"rules\": [\"segwit\"]})");
     //}
 
-    // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != ::ChainActive().Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = nullptr;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = ::ChainActive().Tip();
-        nStart = GetTime();
-
-        // Create new block
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(scriptDummy);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
+    // Update block: the template manager keeps it current and only rebuilds
+    // it for a new tip or once it went stale
+    BlockTemplateManager::Snapshot snapshot = EnsureBlockTemplateManager(request.context).GetTemplate(has_since ? &since : nullptr);
+    nTransactionsUpdatedLast = snapshot.transactions_updated;
+    const CBlockIndex* const pindexPrev = snapshot.prev;
     CHECK_NONFATAL(pindexPrev);
-    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
+    const CBlockTemplate* const pblocktemplate = &snapshot.block_template;
+    CBlock* pblock = &snapshot.block_template.block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
     // Update nTime
@@ -787,6 +808,8 @@ static RPCHelpMan getblocktemplate()
         entry.pushKV("depends", deps);
 
         int index_in_template = i - 1;
+        // The requester already has the transactions before this one
+        if ((size_t)index_in_template < snapshot.unchanged) continue;
         entry.pushKV("fee", pblocktemplate->vTxFees[index_in_template]);
         int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
         if (fPreSegWit) {
@@ -869,6 +892,14 @@ static RPCHelpMan getblocktemplate()
     }
 
     result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
+    result.pushKV("templateid", TemplateIdToString(snapshot.id));
+    if (snapshot.delta) {
+        UniValue removed(UniValue::VARR);
+        for (const uint256& txid : snapshot.removed) {
+            removed.push_back(txid.GetHex());
+        }
+        result.pushKV("removed", removed);
+    }
     result.pushKV("transactions", transactions);
     result.pushKV("coinbaseaux", aux);
     result.pushKV("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue);
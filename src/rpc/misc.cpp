@@ -15,6 +15,7 @@
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/descriptor.h>
+#include <script/sigcache.h>
 #include <util/check.h>
 #include <util/message.h> // For MessageSign(), MessageVerify()
 #include <util/ref.h>
@@ -514,6 +515,40 @@ static RPCHelpMan getmemoryinfo()
     };
 }
 
+static RPCHelpMan getsignaturecacheinfo()
+{
+    return RPCHelpMan{"getsignaturecacheinfo",
+                "Returns statistics about the cache of verified signatures since startup.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "shards", "Number of independently locked parts the cache is split into"},
+                        {RPCResult::Type::NUM, "capacity", "Maximum number of entries the cache can hold"},
+                        {RPCResult::Type::NUM, "hits", "Number of lookups that found the signature"},
+                        {RPCResult::Type::NUM, "misses", "Number of lookups that did not find the signature"},
+                        {RPCResult::Type::NUM, "inserts", "Number of entries added"},
+                        {RPCResult::Type::NUM, "evictions", "Number of entries dropped because no free slot was left for them (entries aged out by newer ones are not counted)"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getsignaturecacheinfo", "")
+            + HelpExampleRpc("getsignaturecacheinfo", "")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const SignatureCacheStats stats = GetSignatureCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("shards", (uint64_t)stats.shards);
+    obj.pushKV("capacity", (uint64_t)stats.capacity);
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    obj.pushKV("inserts", stats.inserts);
+    obj.pushKV("evictions", stats.evictions);
+    return obj;
+},
+    };
+}
+
 static void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -699,6 +734,7 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getsignaturecacheinfo",  &getsignaturecacheinfo,  {} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
@@ -121,6 +121,8 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                             {
                                 {RPCResult::Type::NUM, "n", "The heights of blocks we're currently asking from this peer"},
                             }},
+                            {RPCResult::Type::NUM, "tx_queued", "The number of transactions from this peer waiting to be validated"},
+                            {RPCResult::Type::NUM, "tx_processed", "The total number of transactions from this peer that have been validated"},
                             {RPCResult::Type::BOOL, "whitelisted", "Whether the peer is whitelisted"},
                             {RPCResult::Type::NUM, "minfeefilter", "The minimum fee rate for transactions this peer accepts"},
                             {RPCResult::Type::OBJ_DYN, "bytessent_per_msg", "",
@@ -206,6 +208,8 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("tx_queued", (uint64_t)statestats.m_txs_queued);
+            obj.pushKV("tx_processed", statestats.m_txs_processed);
         }
         obj.pushKV("whitelisted", stats.m_legacyWhitelisted);
         UniValue permissions(UniValue::VARR);
@@ -3,6 +3,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/baddcoin-config.h>
+#endif
+
 #include <script/sigcache.h>
 
 #include <pubkey.h>
@@ -13,65 +17,162 @@
 #include <cuckoocache.h>
 #include <boost/thread/shared_mutex.hpp>
 
-namespace {
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
-{
-private:
-     //! Entries are SHA256(nonce || signature hash || public key || signature):
-    CSHA256 m_salted_hasher;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+
+struct SignatureCache::Shard {
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
     boost::shared_mutex cs_sigcache;
+    size_t capacity{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> inserts{0};
+    std::atomic<uint64_t> evictions{0};
+};
 
-public:
-    CSignatureCache()
-    {
-        uint256 nonce = GetRandHash();
-        // We want the nonce to be 64 bytes long to force the hasher to process
-        // this chunk, which makes later hash computations more efficient. We
-        // just write our 32-byte entropy twice to fill the 64 bytes.
-        m_salted_hasher.Write(nonce.begin(), 32);
-        m_salted_hasher.Write(nonce.begin(), 32);
+namespace {
+#if defined(HAVE_THREAD_LOCAL)
+//! Entries added by this thread that are yet to be written to the cache.
+struct InsertBuffer {
+    const SignatureCache* cache{nullptr};
+    std::vector<uint256> entries;
+};
+thread_local InsertBuffer g_insert_buffer;
+#endif
+
+/* In previous versions of this code, signatureCache was a local static variable
+ * in CachingTransactionSignatureChecker::VerifySignature.  We initialize
+ * signatureCache outside of VerifySignature to avoid the atomic operation per
+ * call overhead associated with local static variables even though
+ * signatureCache could be made local to VerifySignature.
+*/
+static SignatureCache signatureCache;
+} // namespace
+
+SignatureCache::SignatureCache(size_t shards)
+{
+    SetNonce(GetRandHash());
+    for (size_t i = 0; i < std::max<size_t>(shards, 1); ++i) {
+        m_shards.emplace_back(new Shard());
     }
+}
 
-    void
-    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
-    {
-        CSHA256 hasher = m_salted_hasher;
-        hasher.Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
+SignatureCache::~SignatureCache() = default;
+
+void SignatureCache::SetNonce(const uint256& nonce)
+{
+    m_nonce = nonce;
+    // We want the nonce to be 64 bytes long to force the hasher to process
+    // this chunk, which makes later hash computations more efficient. We
+    // just write our 32-byte entropy twice to fill the 64 bytes.
+    m_salted_hasher.Reset();
+    m_salted_hasher.Write(nonce.begin(), 32);
+    m_salted_hasher.Write(nonce.begin(), 32);
+}
+
+void SignatureCache::GetEntries(std::vector<uint256>& entries) const
+{
+    for (const auto& shard : m_shards) {
+        boost::shared_lock<boost::shared_mutex> lock(shard->cs_sigcache);
+        shard->setValid.for_each([&entries](const uint256& entry) { entries.push_back(entry); });
     }
+}
+
+void SignatureCache::ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    CSHA256 hasher = m_salted_hasher;
+    hasher.Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
+}
 
-    bool
-    Get(const uint256& entry, const bool erase)
+bool SignatureCache::Get(const uint256& entry, bool erase)
+{
+    Shard& shard = *m_shards[ShardIndex(entry)];
+    bool found;
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs_sigcache);
+        found = shard.setValid.contains(entry, erase);
     }
+    (found ? shard.hits : shard.misses).fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
 
-    void Set(uint256& entry)
-    {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+void SignatureCache::Insert(std::vector<uint256>& entries)
+{
+    std::sort(entries.begin(), entries.end(), [this](const uint256& a, const uint256& b) { return ShardIndex(a) < ShardIndex(b); });
+    for (auto it = entries.begin(); it != entries.end();) {
+        const size_t index = ShardIndex(*it);
+        Shard& shard = *m_shards[index];
+        uint64_t inserted = 0;
+        uint64_t evicted = 0;
+        {
+            boost::unique_lock<boost::shared_mutex> lock(shard.cs_sigcache);
+            for (; it != entries.end() && ShardIndex(*it) == index; ++it) {
+                if (!shard.setValid.insert(*it)) ++evicted;
+                ++inserted;
+            }
+        }
+        shard.inserts.fetch_add(inserted, std::memory_order_relaxed);
+        shard.evictions.fetch_add(evicted, std::memory_order_relaxed);
     }
-    uint32_t setup_bytes(size_t n)
-    {
-        return setValid.setup_bytes(n);
+}
+
+void SignatureCache::Set(const uint256& entry)
+{
+#if defined(HAVE_THREAD_LOCAL)
+    InsertBuffer& buffer = g_insert_buffer;
+    if (buffer.cache != this) {
+        // Entries left over for another cache are dropped, as it may be gone.
+        buffer.entries.clear();
+        buffer.cache = this;
     }
-};
+    buffer.entries.push_back(entry);
+    if (buffer.entries.size() >= SIGCACHE_INSERT_BUFFER_SIZE) {
+        Flush();
+    }
+#else
+    std::vector<uint256> entries{entry};
+    Insert(entries);
+#endif
+}
 
-/* In previous versions of this code, signatureCache was a local static variable
- * in CachingTransactionSignatureChecker::VerifySignature.  We initialize
- * signatureCache outside of VerifySignature to avoid the atomic operation per
- * call overhead associated with local static variables even though
- * signatureCache could be made local to VerifySignature.
-*/
-static CSignatureCache signatureCache;
-} // namespace
+void SignatureCache::Flush()
+{
+#if defined(HAVE_THREAD_LOCAL)
+    InsertBuffer& buffer = g_insert_buffer;
+    if (buffer.cache != this || buffer.entries.empty()) return;
+    Insert(buffer.entries);
+    buffer.entries.clear();
+#endif
+}
+
+size_t SignatureCache::setup_bytes(size_t bytes)
+{
+    size_t capacity = 0;
+    for (const auto& shard : m_shards) {
+        boost::unique_lock<boost::shared_mutex> lock(shard->cs_sigcache);
+        shard->capacity = shard->setValid.setup_bytes(bytes / m_shards.size());
+        capacity += shard->capacity;
+    }
+    return capacity;
+}
+
+SignatureCacheStats SignatureCache::GetStats() const
+{
+    SignatureCacheStats stats;
+    stats.shards = m_shards.size();
+    for (const auto& shard : m_shards) {
+        {
+            boost::shared_lock<boost::shared_mutex> lock(shard->cs_sigcache);
+            stats.capacity += shard->capacity;
+        }
+        stats.hits += shard->hits.load(std::memory_order_relaxed);
+        stats.misses += shard->misses.load(std::memory_order_relaxed);
+        stats.inserts += shard->inserts.load(std::memory_order_relaxed);
+        stats.evictions += shard->evictions.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
 
 // To be called once in AppInitMain/BasicTestingSetup to initialize the
 // signatureCache.
@@ -85,15 +186,98 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void FlushSignatureCache()
+{
+    signatureCache.Flush();
+}
+
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
+void GetSignatureCacheContents(uint256& nonce, std::vector<uint256>& entries)
+{
+    nonce = signatureCache.GetNonce();
+    signatureCache.GetEntries(entries);
+}
+
+void SetSignatureCacheContents(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.SetNonce(nonce);
+    for (const uint256& entry : entries) {
+        signatureCache.Set(entry);
+    }
+    signatureCache.Flush();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
     if (signatureCache.Get(entry, !store))
         return true;
+    if (m_batch) {
+        m_batch->Add(sighash, pubkey, vchSig, store);
+        return true;
+    }
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
     if (store)
         signatureCache.Set(entry);
     return true;
 }
+
+void SignatureBatch::Add(const uint256& sighash, const CPubKey& pubkey, const std::vector<unsigned char>& sig, bool store)
+{
+    m_entries.push_back(Entry{sighash, pubkey, sig, store, false});
+}
+
+void SignatureBatch::Verify()
+{
+    // Group the checks by public key, with identical checks next to each other.
+    std::vector<size_t> order(m_entries.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        const Entry& ea = m_entries[a];
+        const Entry& eb = m_entries[b];
+        return std::tie(ea.pubkey, ea.sighash, ea.sig) < std::tie(eb.pubkey, eb.sighash, eb.sig);
+    });
+
+    std::vector<std::pair<const uint256*, const std::vector<unsigned char>*>> checks;
+    std::vector<size_t> check_index(order.size());
+    for (size_t begin = 0; begin < order.size();) {
+        const CPubKey& pubkey = m_entries[order[begin]].pubkey;
+        checks.clear();
+        size_t end = begin;
+        for (; end < order.size() && m_entries[order[end]].pubkey == pubkey; ++end) {
+            const Entry& entry = m_entries[order[end]];
+            if (end == begin || entry.sighash != m_entries[order[end - 1]].sighash || entry.sig != m_entries[order[end - 1]].sig) {
+                checks.emplace_back(&entry.sighash, &entry.sig);
+            }
+            check_index[end] = checks.size() - 1;
+        }
+        const std::vector<bool> valid = pubkey.VerifyMany(checks);
+        for (size_t i = begin; i < end; ++i) {
+            m_entries[order[i]].valid = valid[check_index[i]];
+        }
+        begin = end;
+    }
+
+    for (const Entry& entry : m_entries) {
+        if (entry.valid && entry.store) {
+            uint256 cache_entry;
+            signatureCache.ComputeEntry(cache_entry, entry.sighash, entry.sig, entry.pubkey);
+            signatureCache.Set(cache_entry);
+        }
+    }
+    signatureCache.Flush();
+}
+
+bool SignatureBatch::AllValid(size_t begin, size_t end) const
+{
+    for (size_t i = begin; i < end; ++i) {
+        if (!m_entries[i].valid) return false;
+    }
+    return true;
+}
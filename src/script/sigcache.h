@@ -6,8 +6,11 @@
 #ifndef BADDCOIN_SCRIPT_SIGCACHE_H
 #define BADDCOIN_SCRIPT_SIGCACHE_H
 
+#include <crypto/sha256.h>
+#include <pubkey.h>
 #include <script/interpreter.h>
 
+#include <memory>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -16,8 +19,10 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
-
-class CPubKey;
+// Number of independently locked shards the signature cache is split into
+static const unsigned int SIGCACHE_SHARDS = 16;
+// Number of entries a thread adds before they are written to the signature cache
+static const unsigned int SIGCACHE_INSERT_BUFFER_SIZE = 64;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -40,17 +45,111 @@ public:
     }
 };
 
+/** Signature cache activity, summed over all shards. */
+struct SignatureCacheStats {
+    size_t shards{0};
+    size_t capacity{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t inserts{0};
+    uint64_t evictions{0};
+};
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * Entries are spread over shards by their (salted, so random) value, and
+ * each shard has its own lock, so threads looking up or adding different
+ * signatures rarely wait for each other. Entries added by a thread are
+ * buffered and written out together, taking each shard's lock once.
+ */
+class SignatureCache
+{
+private:
+    struct Shard;
+
+    //! Entries are SHA256(nonce || signature hash || public key || signature):
+    uint256 m_nonce;
+    CSHA256 m_salted_hasher;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    size_t ShardIndex(const uint256& entry) const { return entry.begin()[0] % m_shards.size(); }
+    void Insert(std::vector<uint256>& entries);
+
+public:
+    explicit SignatureCache(size_t shards = SIGCACHE_SHARDS);
+    ~SignatureCache();
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+    bool Get(const uint256& entry, bool erase);
+    /** Add an entry. It only becomes visible once this thread calls Flush(), or has added enough entries. */
+    void Set(const uint256& entry);
+    /** Write out the entries this thread has added. */
+    void Flush();
+    /** Size the cache to about the given number of bytes, returning how many entries it can hold. */
+    size_t setup_bytes(size_t bytes);
+    SignatureCacheStats GetStats() const;
+
+    const uint256& GetNonce() const { return m_nonce; }
+    /** Change the nonce entries are computed with. Entries already in the cache are not valid under another nonce. */
+    void SetNonce(const uint256& nonce);
+    /** Append the entries that have not been used up by a block or aged out. */
+    void GetEntries(std::vector<uint256>& entries) const;
+};
+
+/**
+ * Signature checks deferred while running a batch of scripts, so that they
+ * can be verified together once all of the scripts have run. Checks made
+ * with the same public key share the work of parsing it, and repeated
+ * checks are only verified once.
+ */
+class SignatureBatch
+{
+private:
+    struct Entry {
+        uint256 sighash;
+        CPubKey pubkey;
+        std::vector<unsigned char> sig;
+        bool store;
+        bool valid;
+    };
+    std::vector<Entry> m_entries;
+
+public:
+    void Add(const uint256& sighash, const CPubKey& pubkey, const std::vector<unsigned char>& sig, bool store);
+    size_t size() const { return m_entries.size(); }
+
+    /** Verify all deferred checks, adding the valid ones to the signature cache where requested. */
+    void Verify();
+    /** Whether checks [begin, end) were all found valid by Verify(). */
+    bool AllValid(size_t begin, size_t end) const;
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    //! If set, signatures not in the cache are assumed valid and added here to be verified later.
+    SignatureBatch* m_batch;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, SignatureBatch* batch = nullptr) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), m_batch(batch) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
 void InitSignatureCache();
+/** Write out the signature cache entries the calling thread has added. */
+void FlushSignatureCache();
+SignatureCacheStats GetSignatureCacheStats();
+/** Get the nonce and the entries of the signature cache, to save them across restarts. */
+void GetSignatureCacheContents(uint256& nonce, std::vector<uint256>& entries);
+/**
+ * Restore contents saved by GetSignatureCacheContents(). Must be called
+ * after InitSignatureCache() and before any signature is checked.
+ */
+void SetSignatureCacheContents(const uint256& nonce, const std::vector<uint256>& entries);
 
 #endif // BADDCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,189 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BADDCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BADDCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource for node-based containers that allocate their elements one
+ * at a time, such as the mempool's boost::multi_index.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES are carved from chunks of
+ * chunk_size_bytes, with their size rounded up to a multiple of
+ * ELEM_ALIGN_BYTES. A freed block goes onto a free list for its size and is
+ * handed out again by the next allocation of that size. This saves the
+ * malloc overhead of every node, and nodes allocated in a row end up next to
+ * each other. Chunks are only returned to the system when the resource is
+ * destroyed. Larger blocks are passed on to operator new.
+ *
+ * A PoolResource is not thread safe; its users must synchronize access to it.
+ */
+class PoolResource
+{
+public:
+    static constexpr size_t ELEM_ALIGN_BYTES = alignof(std::max_align_t);
+    static constexpr size_t MAX_BLOCK_SIZE_BYTES = 1024;
+
+private:
+    //! A free block, holding the link to the next free block of its size.
+    struct ListNode {
+        ListNode* m_next;
+    };
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES, "a free block must fit the smallest block");
+
+    const size_t m_chunk_size_bytes;
+    std::vector<void*> m_chunks;
+    //! Free lists, indexed by block size in units of ELEM_ALIGN_BYTES.
+    std::array<ListNode*, MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1> m_free_lists{};
+    //! Unused tail of the last chunk.
+    char* m_available_begin{nullptr};
+    char* m_available_end{nullptr};
+    //! Bytes in pooled blocks currently handed out.
+    size_t m_used_bytes{0};
+
+    static size_t NumElemAlignBytes(size_t bytes)
+    {
+        return bytes == 0 ? 1 : (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES;
+    }
+
+    static bool IsPooled(size_t bytes, size_t alignment)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ELEM_ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, size_t index)
+    {
+        m_free_lists[index] = new (p) ListNode{m_free_lists[index]};
+    }
+
+    //! Start a new chunk, keeping the rest of the current one on a free list.
+    void AllocateChunk()
+    {
+        const size_t remaining = m_available_end - m_available_begin;
+        if (remaining > 0) PushFree(m_available_begin, remaining / ELEM_ALIGN_BYTES);
+        void* chunk = ::operator new(m_chunk_size_bytes);
+        m_chunks.push_back(chunk);
+        m_available_begin = static_cast<char*>(chunk);
+        m_available_end = m_available_begin + m_chunk_size_bytes;
+    }
+
+public:
+    explicit PoolResource(size_t chunk_size_bytes = 256 * 1024)
+        : m_chunk_size_bytes(chunk_size_bytes / ELEM_ALIGN_BYTES * ELEM_ALIGN_BYTES)
+    {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+    }
+
+    ~PoolResource()
+    {
+        for (void* chunk : m_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) return ::operator new(bytes);
+
+        const size_t index = NumElemAlignBytes(bytes);
+        const size_t block_bytes = index * ELEM_ALIGN_BYTES;
+        m_used_bytes += block_bytes;
+        if (ListNode* node = m_free_lists[index]) {
+            m_free_lists[index] = node->m_next;
+            return node;
+        }
+        if (static_cast<size_t>(m_available_end - m_available_begin) < block_bytes) {
+            AllocateChunk();
+        }
+        void* p = m_available_begin;
+        m_available_begin += block_bytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment) noexcept
+    {
+        if (!IsPooled(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        const size_t index = NumElemAlignBytes(bytes);
+        m_used_bytes -= index * ELEM_ALIGN_BYTES;
+        PushFree(p, index);
+    }
+
+    //! Bytes taken up by a block of the given size, or 0 if it is not pooled.
+    static size_t PooledBlockSizeBytes(size_t bytes, size_t alignment)
+    {
+        return IsPooled(bytes, alignment) ? NumElemAlignBytes(bytes) * ELEM_ALIGN_BYTES : 0;
+    }
+
+    size_t ChunkSizeBytes() const { return m_chunk_size_bytes; }
+    size_t NumChunks() const { return m_chunks.size(); }
+    //! Bytes in pooled blocks currently handed out, including rounding but not free blocks.
+    size_t UsedBytes() const { return m_used_bytes; }
+};
+
+/**
+ * Allocator handing out memory from a PoolResource. Copies, including those
+ * rebound to another type, share the resource, which must outlive them.
+ */
+template <typename T>
+class PoolAllocator
+{
+    PoolResource* m_resource;
+
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    explicit PoolAllocator(PoolResource* resource) noexcept : m_resource(resource) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : m_resource(other.resource()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    PoolResource* resource() const noexcept { return m_resource; }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BADDCOIN_SUPPORT_ALLOCATORS_POOL_H
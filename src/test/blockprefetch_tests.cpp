@@ -0,0 +1,79 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprefetch.h>
+#include <primitives/block.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockprefetch_tests, BasicTestingSetup)
+
+//! A block whose hash is determined by the position it is "read" from.
+static void FakeBlock(CBlock& block, const FlatFilePos& pos)
+{
+    block.SetNull();
+    block.nNonce = pos.nPos;
+}
+
+static std::vector<std::pair<uint256, FlatFilePos>> MakeSchedule(unsigned int count)
+{
+    std::vector<std::pair<uint256, FlatFilePos>> schedule;
+    for (unsigned int i = 0; i < count; ++i) {
+        CBlock block;
+        FakeBlock(block, FlatFilePos(0, i));
+        schedule.emplace_back(block.GetHash(), FlatFilePos(0, i));
+    }
+    return schedule;
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_in_order)
+{
+    std::atomic<int> reads{0};
+    std::atomic<int> warmed{0};
+    BlockPrefetcher prefetcher(
+        [&](CBlock& block, const FlatFilePos& pos) { ++reads; FakeBlock(block, pos); return true; },
+        [&](const CBlock&) { ++warmed; },
+        /* depth */ 3);
+
+    const auto schedule = MakeSchedule(5);
+    for (size_t i = 0; i < schedule.size(); ++i) {
+        std::shared_ptr<const CBlock> block;
+        // Taking a block the prefetch thread has not started on yet unschedules
+        // it, so keep rescheduling until the thread got to it.
+        while (!block) {
+            prefetcher.Schedule(std::vector<std::pair<uint256, FlatFilePos>>(schedule.begin() + i, schedule.end()));
+            block = prefetcher.Take(schedule[i].first);
+            if (!block) UninterruptibleSleep(std::chrono::milliseconds{1});
+        }
+        BOOST_CHECK(block->GetHash() == schedule[i].first);
+    }
+    prefetcher.Drain();
+    BOOST_CHECK(reads >= 5);
+    BOOST_CHECK_EQUAL(reads.load(), warmed.load());
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_unscheduled_and_failed)
+{
+    const auto schedule = MakeSchedule(2);
+    BlockPrefetcher prefetcher(
+        [&](CBlock& block, const FlatFilePos& pos) { FakeBlock(block, pos); return pos.nPos != 1; },
+        nullptr, /* depth */ 2);
+
+    // Nothing scheduled: the caller has to read the block itself.
+    BOOST_CHECK(!prefetcher.Take(schedule[0].first));
+
+    prefetcher.Schedule(schedule);
+    prefetcher.Drain();
+    BOOST_CHECK(!prefetcher.Take(schedule[0].first));
+
+    // A failed read is not handed out; the caller reads (and reports) it.
+    prefetcher.Schedule({schedule[1]});
+    BOOST_CHECK(!prefetcher.Take(schedule[1].first));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
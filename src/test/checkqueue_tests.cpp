@@ -444,5 +444,67 @@ BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
         tg.join_all();
     }
 }
+
+/** Test that ranges pushed onto a CheckRangeDeque are handed out exactly once,
+ * while the owner takes from one end and other threads steal from the other.
+ */
+BOOST_AUTO_TEST_CASE(test_CheckRangeDeque_Steal)
+{
+    CheckRangeDeque deque;
+    uint64_t range;
+    BOOST_CHECK(!deque.Take(range));
+    BOOST_CHECK(!deque.Steal(range));
+
+    // The owner takes the newest range, thieves the oldest.
+    deque.Push(CheckRangeDeque::Pack(0, 10));
+    deque.Push(CheckRangeDeque::Pack(10, 20));
+    deque.Push(CheckRangeDeque::Pack(20, 30));
+    BOOST_REQUIRE(deque.Take(range));
+    BOOST_CHECK_EQUAL(CheckRangeDeque::Begin(range), 20U);
+    BOOST_CHECK_EQUAL(CheckRangeDeque::End(range), 30U);
+    BOOST_REQUIRE(deque.Steal(range));
+    BOOST_CHECK_EQUAL(CheckRangeDeque::Begin(range), 0U);
+    BOOST_REQUIRE(deque.Take(range));
+    BOOST_CHECK_EQUAL(CheckRangeDeque::Begin(range), 10U);
+    BOOST_CHECK(!deque.Take(range));
+    BOOST_CHECK(!deque.Steal(range));
+
+    // Push enough ranges to grow the deque while it is being stolen from.
+    const uint32_t COUNT = 100000;
+    std::vector<std::atomic<int>> seen(COUNT);
+    std::atomic<bool> pushed{false};
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < SCRIPT_CHECK_THREADS; ++i) {
+        thieves.emplace_back([&] {
+            uint64_t stolen;
+            while (true) {
+                const bool done = pushed;
+                while (deque.Steal(stolen)) {
+                    seen[CheckRangeDeque::Begin(stolen)]++;
+                }
+                if (done) break;
+            }
+        });
+    }
+    for (uint32_t i = 0; i < COUNT; ++i) {
+        deque.Push(CheckRangeDeque::Pack(i, i + 1));
+        if (i % 3 == 0 && deque.Take(range)) {
+            seen[CheckRangeDeque::Begin(range)]++;
+        }
+    }
+    pushed = true;
+    while (deque.Take(range)) {
+        seen[CheckRangeDeque::Begin(range)]++;
+    }
+    for (std::thread& thief : thieves) {
+        thief.join();
+    }
+    bool r = true;
+    for (uint32_t i = 0; i < COUNT; ++i) {
+        r = r && seen[i] == 1;
+    }
+    BOOST_REQUIRE(r);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
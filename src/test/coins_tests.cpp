@@ -12,6 +12,7 @@
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
+#include <util/time.h>
 
 #include <map>
 #include <vector>
@@ -54,7 +55,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -65,7 +66,11 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase) {
+                mapCoins.erase(it++);
+            } else {
+                ++it;
+            }
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -217,7 +222,11 @@ void SimulationTest(CCoinsView* base, bool fake_best_block)
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
                 if (fake_best_block) stack[flushIndex]->SetBestBlock(InsecureRand256());
-                BOOST_CHECK(stack[flushIndex]->Flush());
+                if (InsecureRandBool()) {
+                    BOOST_CHECK(stack[flushIndex]->Flush());
+                } else {
+                    BOOST_CHECK(stack[flushIndex]->PartialFlush(InsecureRandRange(stack[flushIndex]->DynamicMemoryUsage() + 1)));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -464,7 +473,11 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                BOOST_CHECK(stack[flushIndex]->Flush());
+                if (InsecureRandBool()) {
+                    BOOST_CHECK(stack[flushIndex]->Flush());
+                } else {
+                    BOOST_CHECK(stack[flushIndex]->PartialFlush(InsecureRandRange(stack[flushIndex]->DynamicMemoryUsage() + 1)));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -611,7 +624,7 @@ void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
     InsertCoinsMapEntry(map, value, flags);
-    BOOST_CHECK(view.BatchWrite(map, {}));
+    BOOST_CHECK(view.BatchWrite(map, {}, /* erase */ true));
 }
 
 class SingleEntryCacheTest
@@ -878,4 +891,204 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    CCoinsViewDB db{"test", /*nCacheSize*/ 1 << 20, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewPrefetch prefetch(&db, 2);
+
+    // Put a coin into the database.
+    const COutPoint outpoint(InsecureRand256(), 0);
+    {
+        CCoinsViewCache cache(&prefetch);
+        Coin coin;
+        coin.out.nValue = 1234;
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // A block spending it, and an output created within the block itself.
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = outpoint;
+    spend.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(spend));
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(block.vtx.back()->GetHash(), 0);
+    block.vtx.push_back(MakeTransactionRef(child));
+
+    const auto wait_staged = [&] {
+        for (int i = 0; i < 5000 && prefetch.GetStagedCount() == 0; ++i) {
+            UninterruptibleSleep(std::chrono::milliseconds{1});
+        }
+    };
+
+    // Only the outpoint from outside the block gets staged, and it is served once.
+    prefetch.PrefetchInputs(block);
+    wait_staged();
+    prefetch.Drain();
+    BOOST_CHECK_EQUAL(prefetch.GetStagedCount(), 1U);
+    BOOST_CHECK(prefetch.HaveCoin(outpoint));
+    Coin coin;
+    BOOST_CHECK(prefetch.GetCoin(outpoint, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 1234);
+    BOOST_CHECK_EQUAL(prefetch.GetStagedCount(), 0U);
+
+    // Inputs already held by the cache above are not looked up again.
+    {
+        CCoinsViewCache cache(&prefetch);
+        BOOST_CHECK(cache.HaveCoin(outpoint));
+        prefetch.PrefetchInputs(block, &cache);
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+        BOOST_CHECK_EQUAL(prefetch.GetStagedCount(), 0U);
+    }
+
+    // Writing to the database drops staged coins, so a spent coin is never served.
+    prefetch.PrefetchInputs(block);
+    wait_staged();
+    prefetch.Drain();
+    BOOST_CHECK_EQUAL(prefetch.GetStagedCount(), 1U);
+    {
+        CCoinsViewCache cache(&prefetch);
+        BOOST_CHECK(cache.SpendCoin(outpoint));
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(prefetch.GetStagedCount(), 0U);
+    BOOST_CHECK(!prefetch.GetCoin(outpoint, coin));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_partial_flush)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        Coin coin;
+        coin.out.nValue = i + 1;
+        coin.nHeight = 1;
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    cache.SetBestBlock(InsecureRand256());
+
+    // Without a limit, every coin is written but stays cached and clean.
+    BOOST_CHECK(cache.PartialFlush(std::numeric_limits<size_t>::max()));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 99U);
+    cache.SelfTest();
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+        Coin coin;
+        BOOST_CHECK(base.GetCoin(entry.first, coin));
+        BOOST_CHECK(coin == entry.second.coin);
+    }
+
+    // Coins used since the previous flush are the last to be evicted.
+    for (int i = 1; i < 11; ++i) {
+        BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+    }
+    const size_t usage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(cache.PartialFlush(usage / 5));
+    cache.SelfTest();
+    BOOST_CHECK(cache.DynamicMemoryUsage() < usage);
+    BOOST_CHECK(cache.GetCacheSize() >= 10);
+    for (int i = 1; i < 11; ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+    }
+
+    // Evicted coins are read back from the base.
+    const uint64_t misses = cache.GetCacheMisses();
+    const size_t cached = cache.GetCacheSize();
+    for (int i = 1; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, i + 1);
+    }
+    BOOST_CHECK_EQUAL(cache.GetCacheMisses() - misses, 99 - cached);
+    BOOST_CHECK(cache.PartialFlush(0));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_async_writer)
+{
+    CCoinsViewDB db{"test", /*nCacheSize*/ 1 << 20, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewAsyncWriter writer(&db);
+
+    std::vector<COutPoint> outpoints;
+    uint256 best_block;
+    for (int round = 0; round < 10; ++round) {
+        CCoinsViewCache cache(&writer);
+        // Spend the coins of the previous round, add new ones.
+        for (const COutPoint& outpoint : outpoints) {
+            BOOST_CHECK(cache.SpendCoin(outpoint));
+        }
+        outpoints.clear();
+        for (int i = 0; i < 100; ++i) {
+            outpoints.emplace_back(InsecureRand256(), 0);
+            Coin coin;
+            coin.out.nValue = round * 1000 + i;
+            coin.nHeight = round + 1;
+            cache.AddCoin(outpoints.back(), std::move(coin), false);
+        }
+        best_block = InsecureRand256();
+        cache.SetBestBlock(best_block);
+        if (round % 2) {
+            BOOST_CHECK(cache.Flush());
+        } else {
+            BOOST_CHECK(cache.PartialFlush(0));
+        }
+
+        // The new state is visible right away, whether it was written yet or not.
+        BOOST_CHECK(writer.GetBestBlock() == best_block);
+        for (int i = 0; i < 100; ++i) {
+            Coin coin;
+            BOOST_CHECK(writer.GetCoin(outpoints[i], coin));
+            BOOST_CHECK_EQUAL(coin.out.nValue, round * 1000 + i);
+        }
+    }
+
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK_EQUAL(writer.GetPendingCount(), 0U);
+    BOOST_CHECK(db.GetBestBlock() == best_block);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (int i = 0; i < 100; ++i) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(outpoints[i], coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, 9000 + i);
+    }
+    BOOST_CHECK(!db.HaveCoin(COutPoint(InsecureRand256(), 0)));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_async_writer_failure)
+{
+    // The base view refuses all writes.
+    CCoinsView base;
+    CCoinsViewAsyncWriter writer(&base);
+
+    const COutPoint outpoint(InsecureRand256(), 0);
+    {
+        CCoinsViewCache cache(&writer);
+        Coin coin;
+        coin.out.nValue = 1234;
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!writer.Sync());
+
+    // Coins that did not make it to disk are still served, but no more writes are taken.
+    BOOST_CHECK(writer.HaveCoin(outpoint));
+    CCoinsMap map;
+    BOOST_CHECK(!writer.BatchWrite(map, InsecureRand256(), /* erase */ true));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include <deque>
 #include <random.h>
 #include <script/sigcache.h>
+#include <set>
 #include <test/util/setup_common.h>
 #include <thread>
 
@@ -358,6 +359,31 @@ static void test_cache_generations()
     // max_rate_less_than_tight_hit_rate of the time
     BOOST_CHECK(double(out_of_tight_tolerance) / double(total) < max_rate_less_than_tight_hit_rate);
 }
+/* Test that for_each visits every element still in the cache and skips the
+ * ones that were erased.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> inserted;
+    for (int x = 0; x < 1000; ++x) {
+        inserted.push_back(InsecureRand256());
+        cc.insert(inserted.back());
+    }
+    for (size_t x = 0; x < inserted.size(); x += 2) {
+        BOOST_CHECK(cc.contains(inserted[x], true));
+    }
+
+    std::set<uint256> visited;
+    cc.for_each([&visited](const uint256& e) { visited.insert(e); });
+    BOOST_CHECK_EQUAL(visited.size(), inserted.size() / 2);
+    for (size_t x = 0; x < inserted.size(); ++x) {
+        BOOST_CHECK_EQUAL(visited.count(inserted[x]), x % 2);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(cuckoocache_generations)
 {
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
@@ -10,6 +10,7 @@
 #include <net.h>
 #include <net_processing.h>
 #include <pubkey.h>
+#include <script/interpreter.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
@@ -18,6 +19,7 @@
 #include <util/string.h>
 #include <util/system.h>
 #include <util/time.h>
+#include <version.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
@@ -296,6 +298,50 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_validation_queue, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerManager>(chainparams, *connman, nullptr, *m_node.scheduler, *m_node.chainman, *m_node.mempool);
+    peerLogic->StartTxValidation(2);
+
+    CAddress addr(ip(0xa0b0c001), NODE_NONE);
+    CNode dummyNode(id++, ServiceFlags(NODE_NETWORK | NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", ConnectionType::INBOUND);
+    dummyNode.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode);
+    dummyNode.nVersion = 1;
+    dummyNode.fSuccessfullyConnected = true;
+
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(m_coinbase_txns[0]->GetHash(), 0));
+    tx.vout.emplace_back(m_coinbase_txns[0]->vout[0].nValue - CENT, scriptPubKey);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(coinbaseKey.Sign(SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+
+    // The transaction is handed to a validation thread, which adds it to the mempool
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << tx;
+    std::atomic<bool> interrupt{false};
+    peerLogic->ProcessMessage(dummyNode, NetMsgType::TX, stream, GetTime<std::chrono::microseconds>(), interrupt);
+    CNodeStateStats stats;
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_REQUIRE(GetNodeStateStats(dummyNode.GetId(), stats));
+        if (stats.m_txs_processed > 0) break;
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+    }
+    BOOST_CHECK_EQUAL(stats.m_txs_processed, 1U);
+    BOOST_CHECK_EQUAL(stats.m_txs_queued, 0U);
+    BOOST_CHECK(m_node.mempool->exists(tx.GetHash()));
+
+    peerLogic->StopTxValidation();
+    BOOST_CHECK_EQUAL(dummyNode.GetRefCount(), 0);
+    bool dummy;
+    peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
+}
+
 static CTransactionRef RandomOrphan()
 {
     std::map<uint256, COrphanTx>::iterator it;
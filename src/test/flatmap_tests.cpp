@@ -0,0 +1,168 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flatmap.h>
+#include <test/util/setup_common.h>
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatmap_tests, BasicTestingSetup)
+
+namespace {
+//! Poor hash on purpose, so that long probe sequences and wrap-arounds get exercised.
+struct CollidingHasher {
+    size_t operator()(uint32_t key) const { return key % 37; }
+};
+
+typedef flatmap<uint32_t, std::string, CollidingHasher> TestMap;
+
+void CheckEqual(const TestMap& map, const std::map<uint32_t, std::string>& expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    BOOST_CHECK_EQUAL(map.empty(), expected.empty());
+    size_t visited = 0;
+    for (const auto& entry : map) {
+        auto it = expected.find(entry.first);
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK_EQUAL(entry.second, it->second);
+        ++visited;
+    }
+    BOOST_CHECK_EQUAL(visited, expected.size());
+    for (const auto& entry : expected) {
+        auto it = map.find(entry.first);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->second, entry.second);
+    }
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(flatmap_random_ops)
+{
+    TestMap map;
+    std::map<uint32_t, std::string> expected;
+    for (int i = 0; i < 20000; ++i) {
+        const uint32_t key = InsecureRandRange(500);
+        const std::string value = std::to_string(InsecureRand32());
+        switch (InsecureRandRange(4)) {
+        case 0: {
+            auto ret = map.emplace(key, value);
+            BOOST_CHECK_EQUAL(ret.second, expected.emplace(key, value).second);
+            BOOST_CHECK_EQUAL(ret.first->first, key);
+            break;
+        }
+        case 1:
+            map[key] = value;
+            expected[key] = value;
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(map.count(key), expected.count(key));
+            break;
+        }
+        if (i % 1000 == 0) CheckEqual(map, expected);
+    }
+    CheckEqual(map, expected);
+
+    map.clear();
+    expected.clear();
+    CheckEqual(map, expected);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_erase_while_iterating)
+{
+    TestMap map;
+    std::map<uint32_t, std::string> expected;
+    for (uint32_t i = 0; i < 3000; ++i) {
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(i), std::forward_as_tuple(1, 'x'));
+        expected.emplace(i, "x");
+    }
+
+    // References stay valid while other entries come and go.
+    std::string& stable = map.find(1235)->second;
+
+    // Erase every other entry while iterating, both erase idioms.
+    bool use_postfix = false;
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->first % 2 == 0) {
+            expected.erase(it->first);
+            if (use_postfix) {
+                map.erase(it++);
+            } else {
+                it = map.erase(it);
+            }
+            use_postfix = !use_postfix;
+        } else {
+            ++it;
+        }
+    }
+    CheckEqual(map, expected);
+    BOOST_CHECK(&stable == &map.find(1235)->second);
+
+    // Freed entries get reused.
+    const size_t usage = memusage::DynamicUsage(map);
+    for (uint32_t i = 0; i < 3000; i += 2) {
+        map.emplace(i, "y");
+        expected.emplace(i, "y");
+    }
+    CheckEqual(map, expected);
+    BOOST_CHECK(&stable == &map.find(1235)->second);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+
+    // Erasing everything leaves an empty map that can be filled again.
+    for (auto it = map.begin(); it != map.end();) {
+        it = map.erase(it);
+    }
+    expected.clear();
+    CheckEqual(map, expected);
+    map[7] = "z";
+    expected[7] = "z";
+    CheckEqual(map, expected);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_compact)
+{
+    TestMap map;
+    std::map<uint32_t, std::string> expected;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        map.emplace(i, std::to_string(i));
+        expected.emplace(i, std::to_string(i));
+    }
+    const size_t full_usage = memusage::DynamicUsage(map);
+
+    // Erasing alone keeps the memory around for reuse.
+    for (uint32_t i = 0; i < 5000; ++i) {
+        if (InsecureRandBool()) {
+            map.erase(i);
+            expected.erase(i);
+        }
+    }
+    BOOST_CHECK(memusage::DynamicUsage(map) >= full_usage);
+
+    map.compact();
+    CheckEqual(map, expected);
+    BOOST_CHECK(memusage::DynamicUsage(map) < full_usage);
+
+    // The compacted map keeps working.
+    for (uint32_t i = 5000; i < 6000; ++i) {
+        map[i] = "w";
+        expected[i] = "w";
+    }
+    map.erase(17);
+    expected.erase(17);
+    CheckEqual(map, expected);
+
+    for (auto it = map.begin(); it != map.end();) {
+        it = map.erase(it);
+    }
+    map.compact();
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
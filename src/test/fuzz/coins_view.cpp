@@ -136,7 +136,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             }
             bool expected_code_path = false;
             try {
-                coins_view_cache.BatchWrite(coins_map, fuzzed_data_provider.ConsumeBool() ? ConsumeUInt256(fuzzed_data_provider) : coins_view_cache.GetBestBlock());
+                coins_view_cache.BatchWrite(coins_map, fuzzed_data_provider.ConsumeBool() ? ConsumeUInt256(fuzzed_data_provider) : coins_view_cache.GetBestBlock(), fuzzed_data_provider.ConsumeBool());
                 expected_code_path = true;
             } catch (const std::logic_error& e) {
                 if (e.what() == std::string{"FRESH flag misapplied to coin that exists in parent cache"}) {
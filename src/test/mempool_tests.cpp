@@ -537,7 +537,9 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
         pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    // 4 and 6 alone take up about half of the memory, now that the links between
+    // the four transactions are stored compactly, so leave some room over that.
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 5); // should maximize mempool size by only removing 5/7
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
     BOOST_CHECK(pool.exists(tx6.GetHash()));
@@ -788,4 +790,76 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    const auto entry_of = [&](const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(pool.cs) { return &**pool.GetIter(tx->GetHash()); };
+
+    /* A parent paid for by its child forms a single chunk */
+    //
+    // [tx1].0 <- [tx2]
+    //
+    CTransactionRef tx1 = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tx2 = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tx1});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx1));
+    pool.addUnchecked(entry.Fee(50000LL).FromTx(tx2));
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 1U);
+    BOOST_CHECK(entry_of(tx1)->m_cluster == entry_of(tx2)->m_cluster);
+    BOOST_CHECK_EQUAL(entry_of(tx1)->m_cluster->chunks.size(), 1U);
+    BOOST_CHECK_EQUAL(entry_of(tx1)->m_cluster->chunks[0].fee, 51000);
+
+    /* An unrelated transaction starts a cluster of its own */
+    CTransactionRef ty1 = make_tx(/* output_values */ {4 * COIN, 4 * COIN});
+    pool.addUnchecked(entry.Fee(200000LL).FromTx(ty1));
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 2U);
+
+    /* Spending both merges the clusters, best chunks first */
+    //
+    // [tx1].0 <- [tx2].0 <- [tz]
+    //                        |
+    // [ty1].0 ------->-------/
+    //   |
+    //   \---1 <- [tw]
+    //
+    CTransactionRef tz = make_tx(/* output_values */ {12 * COIN}, /* inputs */ {tx2, ty1});
+    CTransactionRef tw = make_tx(/* output_values */ {3 * COIN}, /* inputs */ {ty1}, /* input_indices */ {1});
+    pool.addUnchecked(entry.Fee(100LL).FromTx(tz));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tw));
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 1U);
+    const CTxMemPoolCluster* cluster = entry_of(tz)->m_cluster;
+    BOOST_CHECK_EQUAL(cluster->txs.size(), 5U);
+    BOOST_CHECK(cluster->txs[0] == entry_of(ty1));
+    // tw pays a better feerate than tz, so they share the last chunk.
+    BOOST_REQUIRE_EQUAL(cluster->chunks.size(), 3U);
+    BOOST_CHECK_EQUAL(cluster->chunks[0].fee, 200000);
+    BOOST_CHECK_EQUAL(cluster->chunks[1].fee, 51000);
+    BOOST_CHECK_EQUAL(cluster->chunks[2].fee, 1100);
+
+    /* Removing the link splits the cluster again */
+    pool.removeRecursive(*tz, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 2U);
+    BOOST_CHECK(entry_of(ty1)->m_cluster == entry_of(tw)->m_cluster);
+    BOOST_CHECK(entry_of(ty1)->m_cluster != entry_of(tx1)->m_cluster);
+    BOOST_CHECK_EQUAL(entry_of(tw)->m_cluster->txs.size(), 2U);
+
+    /* Prioritising a transaction relinearizes its cluster */
+    pool.addUnchecked(entry.Fee(100LL).FromTx(tz));
+    pool.PrioritiseTransaction(tz->GetHash(), COIN);
+    cluster = entry_of(tz)->m_cluster;
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 1U);
+    BOOST_REQUIRE_EQUAL(cluster->chunks.size(), 2U);
+    BOOST_CHECK_EQUAL(cluster->chunks[0].fee, 251100 + COIN);
+    BOOST_CHECK(cluster->txs.back() == entry_of(tw));
+
+    /* Mining the roots leaves two independent clusters */
+    pool.removeForBlock({tx1, ty1}, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 2U);
+    BOOST_CHECK(entry_of(tx2)->m_cluster == entry_of(tz)->m_cluster);
+    BOOST_CHECK_EQUAL(entry_of(tw)->m_cluster->txs.size(), 1U);
+    BOOST_CHECK_EQUAL(entry_of(tz)->m_cluster->chunks.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
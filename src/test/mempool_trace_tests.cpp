@@ -0,0 +1,111 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <node/mempool_trace.h>
+#include <primitives/block.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validationinterface.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempool_trace_tests, TestingSetup)
+
+static CTransactionRef MakeTx(int n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << CScriptNum(n);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = n * COIN;
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(record_and_replay)
+{
+    const fs::path path = GetDataDir() / "mempool_trace.dat";
+    CTxMemPool& pool = *m_node.mempool;
+    const CTransactionRef tx1 = MakeTx(1);
+    const CTransactionRef tx2 = MakeTx(2);
+    const CTransactionRef gone = MakeTx(3);
+
+    auto recorder = std::make_shared<MempoolTraceRecorder>(pool, path);
+    BOOST_REQUIRE(recorder->IsRecording());
+    RegisterSharedValidationInterface(recorder);
+    {
+        LOCK2(cs_main, pool.cs);
+        TestMemPoolEntryHelper entry;
+        pool.addUnchecked(entry.Fee(1000).Height(7).SpendsCoinbase(true).SigOpsCost(12).FromTx(tx1));
+        pool.addUnchecked(entry.Fee(2000).FromTx(tx2));
+    }
+    GetMainSignals().TransactionAddedToMempool(tx1);
+    GetMainSignals().TransactionAddedToMempool(gone);
+    GetMainSignals().TransactionRemovedFromMempool(tx2, MemPoolRemovalReason::EXPIRY);
+
+    auto block = std::make_shared<CBlock>();
+    block->vtx.push_back(MakeTx(4));
+    block->vtx.push_back(tx1);
+    CBlockIndex index;
+    index.nHeight = 8;
+    GetMainSignals().BlockConnected(block, &index);
+
+    SyncWithValidationInterfaceQueue();
+    UnregisterSharedValidationInterface(recorder);
+    recorder.reset();
+
+    MempoolTraceReader reader(path);
+    BOOST_CHECK_EQUAL(reader.GetChain(), Params().NetworkIDString());
+    MempoolTraceRecord record;
+
+    // The transaction that never made it into the mempool is skipped
+    BOOST_REQUIRE(reader.Next(record));
+    BOOST_CHECK_EQUAL(record.type, MempoolTraceRecord::ADD);
+    BOOST_CHECK(record.tx->GetHash() == tx1->GetHash());
+    BOOST_CHECK_EQUAL(record.fee, 1000);
+    BOOST_CHECK_EQUAL(record.sigop_cost, 12);
+    BOOST_CHECK_EQUAL(record.entry_height, 7U);
+    BOOST_CHECK(record.spends_coinbase);
+
+    BOOST_REQUIRE(reader.Next(record));
+    BOOST_CHECK_EQUAL(record.type, MempoolTraceRecord::REMOVE);
+    BOOST_CHECK(record.txid == tx2->GetHash());
+    BOOST_CHECK(record.reason == static_cast<uint8_t>(MemPoolRemovalReason::EXPIRY));
+
+    BOOST_REQUIRE(reader.Next(record));
+    BOOST_CHECK_EQUAL(record.type, MempoolTraceRecord::BLOCK);
+    BOOST_CHECK_EQUAL(record.height, 8);
+    BOOST_REQUIRE_EQUAL(record.block_txs.size(), 1U);
+    BOOST_CHECK(record.block_txs[0]->GetHash() == tx1->GetHash());
+
+    BOOST_CHECK(!reader.Next(record));
+}
+
+BOOST_AUTO_TEST_CASE(truncated_trace)
+{
+    const fs::path path = GetDataDir() / "mempool_trace_truncated.dat";
+    MempoolTraceRecord record;
+    record.type = MempoolTraceRecord::ADD;
+    record.tx = MakeTx(1);
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_TRACE_VERSION << std::string("regtest") << record;
+        // A record cut short by a crash ends the trace
+        file << record.type << record.time;
+    }
+    MempoolTraceReader reader(path);
+    BOOST_CHECK(reader.Next(record));
+    BOOST_CHECK(!reader.Next(record));
+
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file << uint64_t{MEMPOOL_TRACE_VERSION + 1};
+    }
+    BOOST_CHECK_THROW(MempoolTraceReader{path}, std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,8 +7,10 @@
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
+#include <consensus/validation.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -16,6 +18,7 @@
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/util/setup_common.h>
 
@@ -526,4 +529,85 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(BlockTemplateManager_updates, TestChain100Setup)
+{
+    auto manager = std::make_shared<BlockTemplateManager>(*m_node.mempool, Params());
+    RegisterSharedValidationInterface(manager);
+
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransactionRef& prev, CAmount fee) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(prev->GetHash(), 0));
+        tx.vout.emplace_back(prev->vout[0].nValue - fee, scriptPubKey);
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        const CTransactionRef ref = MakeTransactionRef(tx);
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(*m_node.mempool, state, ref, nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+        return ref;
+    };
+
+    const BlockTemplateManager::Snapshot first = manager->GetTemplate(nullptr);
+    BOOST_CHECK(!first.delta);
+    BOOST_CHECK_EQUAL(first.block_template.block.vtx.size(), 1U);
+    const CAmount subsidy = first.block_template.block.vtx[0]->vout[0].nValue;
+
+    // New mempool transactions are appended to the template
+    const CTransactionRef parent = spend(m_coinbase_txns[0], CENT);
+    const CTransactionRef child = spend(parent, 2 * CENT);
+    SyncWithValidationInterfaceQueue();
+    const BlockTemplateManager::Snapshot patched = manager->GetTemplate(&first.id);
+    BOOST_CHECK(patched.delta);
+    BOOST_CHECK_EQUAL(patched.id.build, first.id.build);
+    BOOST_CHECK_EQUAL(patched.unchanged, 1U);
+    BOOST_CHECK(patched.removed.empty());
+    const CBlock& block = patched.block_template.block;
+    BOOST_CHECK_EQUAL(block.vtx.size(), 3U);
+    if (block.vtx.size() == 3) {
+        BOOST_CHECK(block.vtx[1]->GetHash() == parent->GetHash());
+        BOOST_CHECK(block.vtx[2]->GetHash() == child->GetHash());
+    }
+    BOOST_CHECK_EQUAL(patched.block_template.vTxFees[0], -3 * CENT);
+    BOOST_CHECK_EQUAL(block.vtx[0]->vout[0].nValue, subsidy + 3 * CENT);
+
+    // The patched template matches a freshly assembled one
+    const std::unique_ptr<CBlockTemplate> rebuilt = BlockAssembler(*m_node.mempool, Params()).CreateNewBlock(CScript() << OP_TRUE);
+    BOOST_CHECK_EQUAL(rebuilt->block.vtx.size(), block.vtx.size());
+    BOOST_CHECK(rebuilt->block.vtx[0]->vout == block.vtx[0]->vout);
+    BOOST_CHECK(rebuilt->vchCoinbaseCommitment == patched.block_template.vchCoinbaseCommitment);
+
+    const BlockTemplateManager::Snapshot unchanged = manager->GetTemplate(&patched.id);
+    BOOST_CHECK(unchanged.delta);
+    BOOST_CHECK_EQUAL(unchanged.unchanged, 3U);
+    BOOST_CHECK(unchanged.removed.empty());
+
+    // Removing a transaction drops its descendants from the template as well
+    {
+        LOCK(m_node.mempool->cs);
+        m_node.mempool->removeRecursive(*parent, MemPoolRemovalReason::CONFLICT);
+    }
+    SyncWithValidationInterfaceQueue();
+    const BlockTemplateManager::Snapshot removed = manager->GetTemplate(&patched.id);
+    BOOST_CHECK(removed.delta);
+    BOOST_CHECK_EQUAL(removed.unchanged, 1U);
+    BOOST_CHECK_EQUAL(removed.removed.size(), 2U);
+    BOOST_CHECK_EQUAL(removed.block_template.block.vtx.size(), 1U);
+    BOOST_CHECK_EQUAL(removed.block_template.vTxFees[0], 0);
+    BOOST_CHECK_EQUAL(removed.block_template.block.vtx[0]->vout[0].nValue, subsidy);
+
+    // A new tip starts a new build, which cannot be served as a delta
+    CreateAndProcessBlock({}, scriptPubKey);
+    SyncWithValidationInterfaceQueue();
+    const BlockTemplateManager::Snapshot next = manager->GetTemplate(&removed.id);
+    BOOST_CHECK(!next.delta);
+    BOOST_CHECK(next.id.build != removed.id.build);
+    BOOST_CHECK(next.prev == WITH_LOCK(cs_main, return ::ChainActive().Tip()));
+
+    UnregisterSharedValidationInterface(manager);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
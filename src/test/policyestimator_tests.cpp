@@ -180,4 +180,55 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(PackageFeeRates)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    LOCK2(cs_main, mpool.cs);
+    TestMemPoolEntryHelper entry;
+    const CAmount parentFee(2000);
+    const CAmount childFee(20000);
+
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].scriptSig = CScript() << std::vector<unsigned char>(100, 'X');
+    parent.vout.resize(1);
+    parent.vout[0].nValue = 0LL;
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vout.resize(1);
+    child.vout[0].nValue = 0LL;
+    const size_t parentSize = GetVirtualTransactionSize(CTransaction(parent));
+    const size_t childSize = GetVirtualTransactionSize(CTransaction(child));
+    const CFeeRate parentRate(parentFee, parentSize);
+    const CFeeRate packageRate(parentFee + childFee, parentSize + childSize);
+
+    // Every block mines a low feerate parent together with the child that pays for it
+    std::vector<CTransactionRef> block;
+    for (int blocknum = 0; blocknum < 100; ++blocknum) {
+        for (int k = 0; k < 4; ++k) {
+            parent.vin[0].prevout.n = 100 * blocknum + k;
+            mpool.addUnchecked(entry.Fee(parentFee).Time(GetTime()).Height(blocknum).FromTx(parent));
+            child.vin[0].prevout = COutPoint(parent.GetHash(), 0);
+            mpool.addUnchecked(entry.Fee(childFee).Time(GetTime()).Height(blocknum).FromTx(child));
+            block.push_back(mpool.get(parent.GetHash()));
+            block.push_back(mpool.get(child.GetHash()));
+        }
+        mpool.removeForBlock(block, blocknum + 1);
+        block.clear();
+    }
+    BOOST_CHECK_EQUAL(mpool.size(), 0U);
+
+    // Both transactions confirm at the package feerate, not at their own
+    const CAmount estimate = feeEst.estimateFee(2).GetFeePerK();
+    BOOST_CHECK(estimate > parentRate.GetFeePerK());
+    BOOST_CHECK(estimate >= packageRate.GetFeePerK() - 1 && estimate <= packageRate.GetFeePerK() + 1);
+
+    // Repeated queries give the same answer
+    FeeCalculation feeCalc1, feeCalc2;
+    BOOST_CHECK(feeEst.estimateSmartFee(2, &feeCalc1, true) == feeEst.estimateSmartFee(2, &feeCalc2, true));
+    BOOST_CHECK(feeCalc1.reason == feeCalc2.reason);
+    BOOST_CHECK_EQUAL(feeCalc1.est.pass.totalConfirmed, feeCalc2.est.pass.totalConfirmed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
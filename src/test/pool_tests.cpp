@@ -0,0 +1,120 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/allocators/pool.h>
+#include <test/util/setup_common.h>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_reuse)
+{
+    PoolResource resource(4096);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 4096U);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 0U);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 0U);
+
+    // Blocks are rounded up to the alignment and carved next to each other
+    const size_t align = PoolResource::ELEM_ALIGN_BYTES;
+    char* a = static_cast<char*>(resource.Allocate(1, 1));
+    char* b = static_cast<char*>(resource.Allocate(align, align));
+    BOOST_CHECK_EQUAL(b - a, (ptrdiff_t)align);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 2 * align);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(a) % align, 0U);
+    BOOST_CHECK_EQUAL(PoolResource::PooledBlockSizeBytes(1, 1), align);
+    BOOST_CHECK_EQUAL(PoolResource::PooledBlockSizeBytes(align + 1, 1), 2 * align);
+    BOOST_CHECK_EQUAL(PoolResource::PooledBlockSizeBytes(PoolResource::MAX_BLOCK_SIZE_BYTES + 1, 1), 0U);
+
+    // A freed block is handed out again for the same size only
+    resource.Deallocate(a, 1, 1);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), align);
+    void* c = resource.Allocate(align + 1, 1);
+    BOOST_CHECK(c != a);
+    void* d = resource.Allocate(align - 1, 1);
+    BOOST_CHECK(d == a);
+
+    resource.Deallocate(b, align, align);
+    resource.Deallocate(c, align + 1, 1);
+    resource.Deallocate(d, align - 1, 1);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_resource_chunks)
+{
+    PoolResource resource(PoolResource::MAX_BLOCK_SIZE_BYTES);
+    const size_t half = PoolResource::MAX_BLOCK_SIZE_BYTES / 2;
+
+    // Filling a chunk starts another one; its unused tail stays available
+    void* a = resource.Allocate(half + 1, 1);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 1U);
+    void* b = resource.Allocate(half + 1, 1);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 2U);
+    void* tail = resource.Allocate(half - PoolResource::ELEM_ALIGN_BYTES, 1);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 2U);
+    BOOST_CHECK(static_cast<char*>(tail) > static_cast<char*>(a) && static_cast<char*>(tail) < static_cast<char*>(a) + resource.ChunkSizeBytes());
+
+    // Blocks above the maximum size bypass the pool
+    void* big = resource.Allocate(PoolResource::MAX_BLOCK_SIZE_BYTES + 1, 1);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 2U);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 2 * (half + PoolResource::ELEM_ALIGN_BYTES) + half - PoolResource::ELEM_ALIGN_BYTES);
+    resource.Deallocate(big, PoolResource::MAX_BLOCK_SIZE_BYTES + 1, 1);
+
+    resource.Deallocate(a, half + 1, 1);
+    resource.Deallocate(b, half + 1, 1);
+    resource.Deallocate(tail, half - PoolResource::ELEM_ALIGN_BYTES, 1);
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_containers)
+{
+    PoolResource resource(4096);
+    {
+        typedef std::map<int, std::string, std::less<int>, PoolAllocator<std::pair<const int, std::string>>> PoolMap;
+        PoolMap map{std::less<int>(), PoolMap::allocator_type(&resource)};
+        std::list<int, PoolAllocator<int>> list{PoolAllocator<int>(&resource)};
+        std::set<int> expected;
+        for (int i = 0; i < 1000; ++i) {
+            const int key = (i * 7919) % 1000;
+            map.emplace(key, std::to_string(key));
+            list.push_back(key);
+            expected.insert(key);
+        }
+        BOOST_CHECK(resource.UsedBytes() > 0);
+        for (int i = 0; i < 1000; i += 2) {
+            map.erase(i);
+            expected.erase(i);
+        }
+        list.remove_if([](int key) { return key % 2 == 0; });
+        BOOST_CHECK_EQUAL(map.size(), expected.size());
+        BOOST_CHECK_EQUAL(list.size(), expected.size());
+        auto it = expected.begin();
+        for (const auto& entry : map) {
+            BOOST_CHECK_EQUAL(entry.first, *it++);
+            BOOST_CHECK_EQUAL(entry.second, std::to_string(entry.first));
+        }
+
+        // Reusing freed nodes does not grow the pool
+        const size_t chunks = resource.NumChunks();
+        for (int i = 0; i < 1000; i += 2) {
+            map.emplace(i, std::to_string(i));
+        }
+        BOOST_CHECK_EQUAL(resource.NumChunks(), chunks);
+        BOOST_CHECK_EQUAL(map.size(), 1000U);
+
+        BOOST_CHECK(map.get_allocator() == PoolAllocator<int>(&resource));
+        PoolResource other(4096);
+        BOOST_CHECK(map.get_allocator() != PoolAllocator<int>(&other));
+    }
+    BOOST_CHECK_EQUAL(resource.UsedBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,159 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pubkey.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <test/util/setup_common.h>
+#include <uint256.h>
+
+#include <thread>
+#include <vector>
+
+#if defined(HAVE_CONFIG_H)
+#include <config/baddcoin-config.h>
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sigcache_buffered_inserts)
+{
+    SignatureCache cache(4);
+    BOOST_CHECK_GE(cache.setup_bytes(1 << 20), 4U);
+
+    const uint256 entry = InsecureRand256();
+    BOOST_CHECK(!cache.Get(entry, false));
+    cache.Set(entry);
+#if defined(HAVE_THREAD_LOCAL)
+    // The entry stays with this thread until it is flushed.
+    BOOST_CHECK(!cache.Get(entry, false));
+#endif
+    cache.Flush();
+    BOOST_CHECK(cache.Get(entry, false));
+
+    // A full buffer is written out without an explicit flush.
+    std::vector<uint256> entries;
+    for (unsigned int i = 0; i < SIGCACHE_INSERT_BUFFER_SIZE; ++i) {
+        entries.push_back(InsecureRand256());
+        cache.Set(entries.back());
+    }
+    for (const uint256& e : entries) {
+        BOOST_CHECK(cache.Get(e, false));
+    }
+
+    const SignatureCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.shards, 4U);
+#if defined(HAVE_THREAD_LOCAL)
+    BOOST_CHECK_EQUAL(stats.misses, 2U);
+#else
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+#endif
+    BOOST_CHECK_EQUAL(stats.hits, 1U + SIGCACHE_INSERT_BUFFER_SIZE);
+    BOOST_CHECK_EQUAL(stats.inserts, 1U + SIGCACHE_INSERT_BUFFER_SIZE);
+    BOOST_CHECK_EQUAL(stats.evictions, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_evictions)
+{
+    // Overfill a cache that holds only a few entries per shard.
+    SignatureCache cache(2);
+    const size_t capacity = cache.setup_bytes(64 * sizeof(uint256));
+    std::vector<uint256> entries;
+    for (size_t i = 0; i < 10 * capacity; ++i) {
+        entries.push_back(InsecureRand256());
+        cache.Set(entries.back());
+    }
+    cache.Flush();
+    size_t found = 0;
+    for (const uint256& entry : entries) {
+        found += cache.Get(entry, false);
+    }
+    BOOST_CHECK_LE(found, capacity);
+
+    const SignatureCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.capacity, capacity);
+    BOOST_CHECK_EQUAL(stats.inserts, 10 * capacity);
+    BOOST_CHECK_EQUAL(stats.hits, found);
+    BOOST_CHECK_LE(stats.evictions, stats.inserts - found);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_concurrent_inserts)
+{
+    SignatureCache cache;
+    cache.setup_bytes(16 << 20);
+
+    const int THREADS = 4;
+    const size_t PER_THREAD = 1000;
+    std::vector<std::vector<uint256>> entries(THREADS);
+    for (auto& thread_entries : entries) {
+        for (size_t i = 0; i < PER_THREAD; ++i) {
+            thread_entries.push_back(InsecureRand256());
+        }
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&cache, &entries, t] {
+            for (const uint256& entry : entries[t]) {
+                cache.Set(entry);
+                cache.Get(entry, false);
+            }
+            cache.Flush();
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    size_t found = 0;
+    for (const auto& thread_entries : entries) {
+        for (const uint256& entry : thread_entries) {
+            found += cache.Get(entry, false);
+        }
+    }
+    BOOST_CHECK_EQUAL(found, THREADS * PER_THREAD);
+    BOOST_CHECK_EQUAL(cache.GetStats().inserts, THREADS * PER_THREAD);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_contents_roundtrip)
+{
+    SignatureCache cache(2);
+    cache.setup_bytes(1 << 20);
+    std::vector<uint256> hashes;
+    std::vector<uint256> entries;
+    const std::vector<unsigned char> sig(72, 0x30);
+    const CPubKey pubkey;
+    for (int i = 0; i < 100; ++i) {
+        hashes.push_back(InsecureRand256());
+        uint256 entry;
+        cache.ComputeEntry(entry, hashes.back(), sig, pubkey);
+        entries.push_back(entry);
+        cache.Set(entry);
+    }
+    cache.Flush();
+    // Entries used up by a block are not saved.
+    BOOST_CHECK(cache.Get(entries[0], true));
+
+    std::vector<uint256> saved;
+    cache.GetEntries(saved);
+    BOOST_CHECK_EQUAL(saved.size(), entries.size() - 1);
+
+    // A cache restored with the same nonce computes the same entries and finds them.
+    SignatureCache restored(4);
+    restored.setup_bytes(1 << 20);
+    BOOST_CHECK(restored.GetNonce() != cache.GetNonce());
+    restored.SetNonce(cache.GetNonce());
+    for (const uint256& entry : saved) {
+        restored.Set(entry);
+    }
+    restored.Flush();
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        uint256 entry;
+        restored.ComputeEntry(entry, hashes[i], sig, pubkey);
+        BOOST_CHECK(entry == entries[i]);
+        BOOST_CHECK_EQUAL(restored.Get(entry, false), i != 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
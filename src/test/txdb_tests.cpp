@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <fs.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txdb_tests, TestChain100Setup)
+
+//! Check that blockman holds the same entries as the active block index.
+static void CheckLoadedIndex(BlockManager& blockman) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    BOOST_CHECK_EQUAL(blockman.m_block_index.size(), g_chainman.BlockIndex().size());
+    for (const auto& item : g_chainman.BlockIndex()) {
+        const CBlockIndex* expected = item.second;
+        const auto it = blockman.m_block_index.find(item.first);
+        BOOST_REQUIRE(it != blockman.m_block_index.end());
+        const CBlockIndex* loaded = it->second;
+        BOOST_CHECK_EQUAL(loaded->GetBlockHash(), expected->GetBlockHash());
+        BOOST_CHECK_EQUAL(loaded->pprev ? loaded->pprev->GetBlockHash() : uint256(), expected->pprev ? expected->pprev->GetBlockHash() : uint256());
+        BOOST_CHECK_EQUAL(loaded->nHeight, expected->nHeight);
+        BOOST_CHECK_EQUAL(loaded->nStatus, expected->nStatus);
+        BOOST_CHECK_EQUAL(loaded->nTx, expected->nTx);
+        BOOST_CHECK_EQUAL(loaded->nFile, expected->nFile);
+        BOOST_CHECK_EQUAL(loaded->nDataPos, expected->nDataPos);
+        BOOST_CHECK_EQUAL(loaded->nUndoPos, expected->nUndoPos);
+        BOOST_CHECK_EQUAL(loaded->GetBlockHeader().GetHash(), expected->GetBlockHash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot)
+{
+    LOCK(cs_main);
+    ::ChainstateActive().ForceFlushStateToDisk();
+
+    const Consensus::Params& params = Params().GetConsensus();
+    const fs::path path = GetDataDir() / "index.snapshot";
+    std::vector<const CBlockIndex*> entries;
+    for (const auto& item : g_chainman.BlockIndex()) {
+        entries.push_back(item.second);
+    }
+
+    // Without a snapshot, the index is loaded from the database.
+    BlockManager from_db;
+    const auto insert_db = [&](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return from_db.InsertBlockIndex(hash); };
+    BOOST_CHECK(!pblocktree->LoadBlockIndexSnapshot(path, params, insert_db));
+    BOOST_CHECK(from_db.m_block_index.empty());
+    BOOST_CHECK(pblocktree->LoadBlockIndexGuts(params, insert_db));
+    CheckLoadedIndex(from_db);
+
+    BOOST_REQUIRE(pblocktree->WriteBlockIndexSnapshot(path, entries));
+    BlockManager from_snapshot;
+    const auto insert_snapshot = [&](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return from_snapshot.InsertBlockIndex(hash); };
+    BOOST_CHECK(pblocktree->LoadBlockIndexSnapshot(path, params, insert_snapshot));
+    CheckLoadedIndex(from_snapshot);
+
+    // A corrupted snapshot is rejected before anything is loaded.
+    {
+        FILE* file = fsbridge::fopen(path, "r+b");
+        BOOST_REQUIRE(file);
+        BOOST_REQUIRE(fseek(file, 100, SEEK_SET) == 0);
+        const unsigned char byte = 0xff;
+        BOOST_REQUIRE(fwrite(&byte, 1, 1, file) == 1);
+        fclose(file);
+    }
+    BlockManager from_corrupted;
+    BOOST_CHECK(!pblocktree->LoadBlockIndexSnapshot(path, params, [&](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return from_corrupted.InsertBlockIndex(hash); }));
+    BOOST_CHECK(from_corrupted.m_block_index.empty());
+
+    // Writing any block index entry to the database invalidates the snapshot.
+    BOOST_REQUIRE(pblocktree->WriteBlockIndexSnapshot(path, entries));
+    BOOST_REQUIRE(pblocktree->WriteBatchSync({}, 0, {::ChainActive().Tip()}));
+    BlockManager from_stale;
+    BOOST_CHECK(!pblocktree->LoadBlockIndexSnapshot(path, params, [&](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return from_stale.InsertBlockIndex(hash); }));
+    BOOST_CHECK(from_stale.m_block_index.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,15 @@
 
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
 #include <test/util/setup_common.h>
+#include <txmempool.h>
 #include <validation.h>
 
+#include <thread>
+#include <vector>
+
 #include <boost/test/unit_test.hpp>
 
 
@@ -52,4 +57,68 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Accept transactions without holding cs_main, from several threads at once.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_concurrent, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransactionRef& prev, CAmount fee, const CKey& key) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(prev->GetHash(), 0));
+        tx.vout.emplace_back(prev->vout[0].nValue - fee, scriptPubKey);
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    };
+
+    // Mature the coinbases spent below
+    for (int i = 0; i < 6; ++i) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+
+    // Independent transactions accepted by concurrent threads all end up in the mempool
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < 4; ++i) {
+        txs.push_back(spend(m_coinbase_txns[i], CENT, coinbaseKey));
+    }
+    std::vector<std::thread> threads;
+    std::vector<int> accepted(txs.size(), 0);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        threads.emplace_back([&, i] {
+            TxValidationState state;
+            accepted[i] = AcceptToMemoryPoolConcurrent(*m_node.mempool, state, txs[i], nullptr /* plTxnReplaced */, 0 /* nAbsurdFee */);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < txs.size(); ++i) {
+        BOOST_CHECK(accepted[i]);
+        BOOST_CHECK(m_node.mempool->exists(txs[i]->GetHash()));
+    }
+
+    // A conflicting spend is rejected
+    TxValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPoolConcurrent(*m_node.mempool, state, spend(m_coinbase_txns[0], 2 * CENT, coinbaseKey), nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "txn-mempool-conflict");
+
+    // So is a spend with an invalid signature
+    CKey other_key;
+    other_key.MakeNewKey(true);
+    state = TxValidationState();
+    BOOST_CHECK(!AcceptToMemoryPoolConcurrent(*m_node.mempool, state, spend(m_coinbase_txns[4], CENT, other_key), nullptr, 0));
+    BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
+
+    // A test accept leaves the mempool alone
+    const CTransactionRef test_tx = spend(m_coinbase_txns[5], CENT, coinbaseKey);
+    state = TxValidationState();
+    BOOST_CHECK(AcceptToMemoryPoolConcurrent(*m_node.mempool, state, test_tx, nullptr, 0, /* test_accept */ true));
+    BOOST_CHECK(!m_node.mempool->exists(test_tx->GetHash()));
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), txs.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <test/util/setup_common.h>
+#include <test/util/transaction_utils.h>
 #include <txmempool.h>
 #include <validation.h>
 
@@ -371,4 +372,64 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_batch_signatures, BasicTestingSetup)
+{
+    g_batch_signature_checks = true;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS;
+
+    std::vector<CKey> keys(3);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+    }
+    CMutableTransaction tx_credit;
+    CMutableTransaction tx_spend = BuildP2WPKHSpendingTransaction(keys, 24, tx_credit);
+
+    // A bare 2-of-3 multisig signed by the first and last key. Checking the
+    // signatures against the keys in order pairs the second signature with
+    // the wrong key, which a batch must not hold against the script.
+    const CScript multisig = CScript() << OP_2 << ToByteVector(keys[0].GetPubKey()) << ToByteVector(keys[1].GetPubKey()) << ToByteVector(keys[2].GetPubKey()) << OP_3 << OP_CHECKMULTISIG;
+    CMutableTransaction multisig_credit = BuildCreditingTransaction(multisig, 1);
+    CMutableTransaction multisig_spend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(multisig_credit));
+    const uint256 multisig_hash = SignatureHash(multisig, multisig_spend, 0, SIGHASH_ALL, 1, SigVersion::BASE);
+    std::vector<unsigned char> sig0, sig2;
+    BOOST_REQUIRE(keys[0].Sign(multisig_hash, sig0));
+    BOOST_REQUIRE(keys[2].Sign(multisig_hash, sig2));
+    sig0.push_back(SIGHASH_ALL);
+    sig2.push_back(SIGHASH_ALL);
+    multisig_spend.vin[0].scriptSig = CScript() << OP_0 << sig0 << sig2;
+    const CTransaction multisig_tx(multisig_spend);
+    PrecomputedTransactionData multisig_txdata(multisig_tx);
+
+    const auto run_batch = [&](const CTransaction& tx, PrecomputedTransactionData& txdata, std::vector<CScriptCheck>& checks) {
+        checks.clear();
+        for (size_t i = 0; i < tx.vin.size(); ++i) {
+            checks.emplace_back(tx_credit.vout[i], tx, i, flags, false, &txdata);
+        }
+        checks.emplace_back(multisig_credit.vout[0], multisig_tx, 0, flags, false, &multisig_txdata);
+        return RunCheckBatch(checks);
+    };
+
+    {
+        const CTransaction tx(tx_spend);
+        PrecomputedTransactionData txdata(tx);
+        std::vector<CScriptCheck> checks;
+        BOOST_CHECK(run_batch(tx, txdata, checks));
+    }
+
+    // An invalid signature fails the batch with the same error as checking
+    // the input on its own.
+    tx_spend.vin[5].scriptWitness.stack[0][10] ^= 1;
+    {
+        const CTransaction tx(tx_spend);
+        PrecomputedTransactionData txdata(tx);
+        std::vector<CScriptCheck> checks;
+        BOOST_CHECK(!run_batch(tx, txdata, checks));
+        CScriptCheck single(tx_credit.vout[5], tx, 5, flags, false, &txdata);
+        BOOST_CHECK(!single());
+        BOOST_CHECK_EQUAL(checks[5].GetScriptError(), single.GetScriptError());
+    }
+
+    g_batch_signature_checks = DEFAULT_BATCH_SIGNATURE_CHECKS;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
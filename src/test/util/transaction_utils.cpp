@@ -3,7 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <coins.h>
+#include <key.h>
+#include <script/interpreter.h>
 #include <script/signingprovider.h>
+#include <script/standard.h>
 #include <test/util/transaction_utils.h>
 
 CMutableTransaction BuildCreditingTransaction(const CScript& scriptPubKey, int nValue)
@@ -40,6 +43,43 @@ CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, const CSc
     return txSpend;
 }
 
+CMutableTransaction BuildP2WPKHSpendingTransaction(const std::vector<CKey>& keys, size_t num_inputs, CMutableTransaction& txCreditRet)
+{
+    txCreditRet = BuildCreditingTransaction(CScript(), 0);
+    txCreditRet.vout.resize(num_inputs);
+    for (size_t i = 0; i < num_inputs; ++i) {
+        txCreditRet.vout[i].scriptPubKey = GetScriptForDestination(WitnessV0KeyHash(keys[i % keys.size()].GetPubKey()));
+        txCreditRet.vout[i].nValue = 1;
+    }
+    const uint256 credit_hash = txCreditRet.GetHash();
+
+    CMutableTransaction txSpend;
+    txSpend.nVersion = 1;
+    txSpend.nLockTime = 0;
+    txSpend.vin.resize(num_inputs);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].scriptPubKey = CScript();
+    txSpend.vout[0].nValue = num_inputs;
+    for (size_t i = 0; i < num_inputs; ++i) {
+        txSpend.vin[i].prevout = COutPoint(credit_hash, i);
+        txSpend.vin[i].nSequence = CTxIn::SEQUENCE_FINAL;
+        txSpend.vin[i].scriptWitness.stack.resize(2);
+    }
+    // The witness is only filled in below, but it must be present for the
+    // precomputed data to cover the transaction.
+    const PrecomputedTransactionData txdata(txSpend);
+    for (size_t i = 0; i < num_inputs; ++i) {
+        const CKey& key = keys[i % keys.size()];
+        const CScript script_code = GetScriptForDestination(PKHash(key.GetPubKey()));
+        std::vector<unsigned char> sig;
+        key.Sign(SignatureHash(script_code, txSpend, i, SIGHASH_ALL, 1, SigVersion::WITNESS_V0, &txdata), sig);
+        sig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        txSpend.vin[i].scriptWitness.stack = {sig, ToByteVector(key.GetPubKey())};
+    }
+
+    return txSpend;
+}
+
 std::vector<CMutableTransaction> SetupDummyInputs(FillableSigningProvider& keystoreRet, CCoinsViewCache& coinsRet, const std::array<CAmount,4>& nValues)
 {
     std::vector<CMutableTransaction> dummyTransactions;
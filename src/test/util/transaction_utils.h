@@ -8,7 +8,9 @@
 #include <primitives/transaction.h>
 
 #include <array>
+#include <vector>
 
+class CKey;
 class FillableSigningProvider;
 class CCoinsViewCache;
 
@@ -21,6 +23,11 @@ CMutableTransaction BuildCreditingTransaction(const CScript& scriptPubKey, int n
 //  1 output with empty scriptPubKey, full value of referenced transaction]
 CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, const CScriptWitness& scriptWitness, const CTransaction& txCredit);
 
+// create a transaction spending num_inputs P2WPKH outputs of txCreditRet,
+// paid to each of keys in turn and signed with them
+// [num_inputs inputs => 1 output with empty scriptPubKey]
+CMutableTransaction BuildP2WPKHSpendingTransaction(const std::vector<CKey>& keys, size_t num_inputs, CMutableTransaction& txCreditRet);
+
 // Helper: create two dummy transactions, each with two outputs.
 // The first has nValues[0] and nValues[1] outputs paid to a TxoutType::PUBKEY,
 // the second nValues[2] and nValues[3] outputs paid to a TxoutType::PUBKEYHASH.
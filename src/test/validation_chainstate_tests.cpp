@@ -64,7 +64,19 @@ BOOST_AUTO_TEST_CASE(validation_chainstate_resize_caches)
             1 << 23  // upsizing the coinsdb cache
         );
 
-        // The view cache should be empty since we had to destruct to downsize.
+        // Downsizing flushed the coin to disk, but it fits into the part of
+        // the smaller cache that is kept (see -dbcacheretain).
+        BOOST_CHECK(c1.CoinsDB().HaveCoin(outpoint));
+        BOOST_CHECK(c1.CoinsTip().HaveCoinInCache(outpoint));
+
+        // Without retention, the view cache is emptied on downsize.
+        const int old_retain = g_dbcache_retain;
+        g_dbcache_retain = 0;
+        c1.ResizeCoinsCaches(
+            1 << 21,  // downsizing the coinsview cache
+            1 << 23
+        );
+        g_dbcache_retain = old_retain;
         BOOST_CHECK(!c1.CoinsTip().HaveCoinInCache(outpoint));
     }
 
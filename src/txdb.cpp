@@ -5,6 +5,8 @@
 
 #include <txdb.h>
 
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <node/ui_interface.h>
 #include <pow.h>
 #include <random.h>
@@ -15,8 +17,18 @@
 #include <util/translation.h>
 #include <util/vector.h>
 
+#include <algorithm>
+#include <atomic>
+#include <set>
 #include <stdint.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
@@ -27,6 +39,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'S';
 
 namespace {
 
@@ -77,7 +90,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -113,7 +126,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -143,6 +156,265 @@ size_t CCoinsViewDB::EstimateSize() const
     return m_db->EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* view, int threads) : CCoinsViewBacked(view)
+{
+    for (int i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&TraceThread<std::function<void()>>, "coinprefetch", std::function<void()>(std::bind(&CCoinsViewPrefetch::ThreadLookup, this)));
+    }
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (std::thread& thread : m_threads) {
+        if (thread.joinable()) thread.join();
+    }
+}
+
+void CCoinsViewPrefetch::PrefetchInputs(const CBlock& block, const CCoinsViewCache* cache)
+{
+    if (m_threads.empty()) return;
+
+    std::set<uint256> created;
+    for (const auto& tx : block.vtx) {
+        created.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (created.count(txin.prevout.hash)) continue;
+            if (cache && cache->HaveCoinInCache(txin.prevout)) continue;
+            outpoints.push_back(txin.prevout);
+        }
+    }
+    // Neighbouring keys tend to share leveldb blocks.
+    std::sort(outpoints.begin(), outpoints.end());
+
+    {
+        LOCK(m_mutex);
+        if (m_staged.size() >= MAX_PREFETCH_STAGED_COINS) return;
+        for (size_t i = 0; i < outpoints.size(); i += PREFETCH_BATCH_SIZE) {
+            const size_t end = std::min(outpoints.size(), i + PREFETCH_BATCH_SIZE);
+            m_queue.emplace_back(outpoints.begin() + i, outpoints.begin() + end);
+        }
+    }
+    m_cond.notify_all();
+}
+
+void CCoinsViewPrefetch::Drain()
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_queue.clear();
+    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_busy == 0; });
+}
+
+void CCoinsViewPrefetch::ThreadLookup()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_queue.empty(); });
+        if (m_stop) return;
+
+        std::vector<COutPoint> batch = std::move(m_queue.front());
+        m_queue.pop_front();
+        const uint64_t generation = m_generation;
+        ++m_busy;
+
+        std::vector<std::pair<COutPoint, Coin>> found;
+        found.reserve(batch.size());
+        {
+            REVERSE_LOCK(lock);
+            for (const COutPoint& outpoint : batch) {
+                Coin coin;
+                try {
+                    if (base->GetCoin(outpoint, coin)) found.emplace_back(outpoint, std::move(coin));
+                } catch (const std::runtime_error&) {
+                    // Leave read errors to the synchronous lookup, which knows how to report them.
+                }
+            }
+        }
+
+        if (generation == m_generation) {
+            for (auto& entry : found) {
+                if (m_staged.size() >= MAX_PREFETCH_STAGED_COINS) break;
+                m_staged.emplace(entry.first, std::move(entry.second));
+            }
+        }
+        --m_busy;
+        if (m_busy == 0) m_cond.notify_all();
+    }
+}
+
+bool CCoinsViewPrefetch::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    if (!m_threads.empty()) {
+        LOCK(m_mutex);
+        auto it = m_staged.find(outpoint);
+        if (it != m_staged.end()) {
+            coin = std::move(it->second);
+            m_staged.erase(it);
+            ++m_hits;
+            return true;
+        }
+        ++m_misses;
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewPrefetch::HaveCoin(const COutPoint& outpoint) const
+{
+    if (!m_threads.empty()) {
+        LOCK(m_mutex);
+        if (m_staged.count(outpoint)) return true;
+    }
+    return base->HaveCoin(outpoint);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase)
+{
+    // Anything staged or being looked up may be overwritten by this write,
+    // both before it starts and while it is partially applied.
+    {
+        LOCK(m_mutex);
+        ++m_generation;
+        LogPrint(BCLog::COINDB, "Prefetch staging served %u of %u cache misses, dropping %u staged coins\n", m_hits, m_hits + m_misses, m_staged.size());
+        m_staged.clear();
+        m_hits = m_misses = 0;
+    }
+    bool ret = base->BatchWrite(mapCoins, hashBlock, erase);
+    {
+        LOCK(m_mutex);
+        ++m_generation;
+        m_staged.clear();
+    }
+    return ret;
+}
+
+size_t CCoinsViewPrefetch::GetStagedCount() const
+{
+    LOCK(m_mutex);
+    return m_staged.size();
+}
+
+CCoinsViewAsyncWriter::CCoinsViewAsyncWriter(CCoinsView* view) : CCoinsViewBacked(view)
+{
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "coinwriter", std::function<void()>(std::bind(&CCoinsViewAsyncWriter::ThreadWrite, this)));
+}
+
+CCoinsViewAsyncWriter::~CCoinsViewAsyncWriter()
+{
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void CCoinsViewAsyncWriter::ThreadWrite()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || m_writing; });
+        // Finish a write handed over before shutdown.
+        if (!m_writing) return;
+
+        CCoinsMap& pending = m_pending;
+        const uint256 block = m_pending_block;
+        const int64_t start = GetTimeMicros();
+        bool ok = false;
+        {
+            REVERSE_LOCK(lock);
+            try {
+                ok = base->BatchWrite(pending, block, /* erase */ false);
+            } catch (const std::runtime_error& e) {
+                LogPrintf("Error writing to coin database in the background: %s\n", e.what());
+            }
+        }
+        if (ok) {
+            LogPrint(BCLog::COINDB, "Wrote %u coins in the background in %.2fs\n", m_pending.size(), (GetTimeMicros() - start) * 0.000001);
+            m_pending.clear();
+            m_pending_block.SetNull();
+        } else {
+            // Keep serving the coins that may not have made it to disk.
+            m_failed = true;
+        }
+        m_writing = false;
+        m_cond.notify_all();
+    }
+}
+
+bool CCoinsViewAsyncWriter::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        LOCK(m_mutex);
+        CCoinsMap::const_iterator it = m_pending.find(outpoint);
+        if (it != m_pending.end()) {
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewAsyncWriter::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        LOCK(m_mutex);
+        CCoinsMap::const_iterator it = m_pending.find(outpoint);
+        if (it != m_pending.end()) return !it->second.coin.IsSpent();
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestBlock() const
+{
+    {
+        LOCK(m_mutex);
+        if (!m_pending_block.IsNull()) return m_pending_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewAsyncWriter::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase)
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_writing; });
+    if (m_failed) return false;
+    assert(m_pending.empty());
+
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        if (erase) {
+            m_pending.emplace(it->first, std::move(it->second));
+        } else {
+            m_pending.emplace(it->first, CCoinsCacheEntry(it->second));
+        }
+    }
+    m_pending_block = hashBlock;
+    m_writing = true;
+    m_cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewAsyncWriter::Sync()
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_writing; });
+    return !m_failed;
+}
+
+size_t CCoinsViewAsyncWriter::GetPendingCount() const
+{
+    LOCK(m_mutex);
+    return m_pending.size();
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -225,6 +497,10 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
+    if (!blockinfo.empty()) {
+        // Any block index snapshot no longer matches.
+        batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
+    }
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
@@ -243,47 +519,93 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+namespace {
+
+/**
+ * Split [0, count) into contiguous ranges and call fn(begin, end) on each,
+ * from up to MAX_BLOCK_INDEX_LOAD_THREADS threads including the caller.
+ */
+void ForEachRangeInParallel(size_t count, const std::function<void(size_t, size_t)>& fn)
+{
+    const size_t threads = std::max<size_t>(1, std::min<size_t>({size_t(GetNumCores()), size_t(MAX_BLOCK_INDEX_LOAD_THREADS), count / 1024}));
+    const size_t per_thread = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        const size_t begin = std::min(count, i * per_thread);
+        const size_t end = std::min(count, begin + per_thread);
+        workers.emplace_back(&TraceThread<std::function<void()>>, "loadblkindex", std::function<void()>([&fn, begin, end] { fn(begin, end); }));
+    }
+    fn(0, std::min(count, per_thread));
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+//! Copy a record read from disk into the entry insertBlockIndex returns for hash.
+bool InsertDiskBlockIndex(const CDiskBlockIndex& diskindex, const uint256& hash, const Consensus::Params& consensusParams, const std::function<CBlockIndex*(const uint256&)>& insertBlockIndex)
+{
+    // Construct block index object
+    CBlockIndex* pindexNew = insertBlockIndex(hash);
+    pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+    pindexNew->nHeight        = diskindex.nHeight;
+    pindexNew->nFile          = diskindex.nFile;
+    pindexNew->nDataPos       = diskindex.nDataPos;
+    pindexNew->nUndoPos       = diskindex.nUndoPos;
+    pindexNew->nVersion       = diskindex.nVersion;
+    pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+    pindexNew->nTime          = diskindex.nTime;
+    pindexNew->nBits          = diskindex.nBits;
+    pindexNew->nNonce         = diskindex.nNonce;
+    pindexNew->nStatus        = diskindex.nStatus;
+    pindexNew->nTx            = diskindex.nTx;
+
+    //FIX when block 0's diffdata doesnt match nbits (genesis block) -- add skip rule !pindexNew->nHeight == 0 &&
+    //LogPrintf("DEBUG: prevHeight: %s\n", pindexNew->nHeight);
+
+    if (!pindexNew->nHeight == 0 && !CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
+        return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+    return true;
+}
+
+} // namespace
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load m_block_index
-    while (pcursor->Valid()) {
+    // Load m_block_index. Records are read in batches; hashing their headers
+    // is what dominates, so that is spread over several threads before the
+    // batch is inserted in database order.
+    std::vector<CDiskBlockIndex> batch;
+    std::vector<uint256> hashes;
+    batch.reserve(BLOCK_INDEX_LOAD_BATCH_SIZE);
+    bool done = false;
+    while (!done) {
         if (ShutdownRequested()) return false;
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-		//FIX when block 0's diffdata doesnt match nbits (genesis block) -- add skip rule !pindexNew->nHeight == 0 &&
-		//LogPrintf("DEBUG: prevHeight: %s\n", pindexNew->nHeight);
-
-                if (!pindexNew->nHeight == 0 && !CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-
-            } else {
+        batch.clear();
+        while (batch.size() < BLOCK_INDEX_LOAD_BATCH_SIZE) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                done = true;
+                break;
+            }
+            batch.emplace_back();
+            if (!pcursor->GetValue(batch.back())) {
                 return error("%s: failed to read value", __func__);
             }
-        } else {
-            break;
+            pcursor->Next();
+        }
+
+        hashes.resize(batch.size());
+        ForEachRangeInParallel(batch.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                hashes[i] = batch[i].GetBlockHash();
+            }
+        });
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!InsertDiskBlockIndex(batch[i], hashes[i], consensusParams, insertBlockIndex)) return false;
         }
     }
 
@@ -292,6 +614,202 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 
 namespace {
 
+//! Identifies a block index snapshot file.
+const unsigned char BLOCK_INDEX_SNAPSHOT_MAGIC[4] = {'b', 'i', 'd', 'x'};
+const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
+//! Magic, version and record count.
+const size_t BLOCK_INDEX_SNAPSHOT_HEADER_SIZE = 16;
+//! Block hash, previous block hash and merkle root followed by ten 32-bit fields.
+const size_t BLOCK_INDEX_SNAPSHOT_RECORD_SIZE = 3 * 32 + 10 * 4;
+
+void EncodeSnapshotRecord(const CBlockIndex& index, unsigned char* out)
+{
+    const uint256 hash = index.GetBlockHash();
+    const uint256 hash_prev = index.pprev ? index.pprev->GetBlockHash() : uint256();
+    memcpy(out, hash.begin(), 32);
+    memcpy(out + 32, hash_prev.begin(), 32);
+    memcpy(out + 64, index.hashMerkleRoot.begin(), 32);
+    WriteLE32(out + 96, index.nHeight);
+    WriteLE32(out + 100, index.nStatus);
+    WriteLE32(out + 104, index.nTx);
+    WriteLE32(out + 108, index.nFile);
+    WriteLE32(out + 112, index.nDataPos);
+    WriteLE32(out + 116, index.nUndoPos);
+    WriteLE32(out + 120, index.nVersion);
+    WriteLE32(out + 124, index.nTime);
+    WriteLE32(out + 128, index.nBits);
+    WriteLE32(out + 132, index.nNonce);
+}
+
+void DecodeSnapshotRecord(const unsigned char* in, uint256& hash, CDiskBlockIndex& index)
+{
+    memcpy(hash.begin(), in, 32);
+    memcpy(index.hashPrev.begin(), in + 32, 32);
+    memcpy(index.hashMerkleRoot.begin(), in + 64, 32);
+    index.nHeight = ReadLE32(in + 96);
+    index.nStatus = ReadLE32(in + 100);
+    index.nTx = ReadLE32(in + 104);
+    index.nFile = ReadLE32(in + 108);
+    index.nDataPos = ReadLE32(in + 112);
+    index.nUndoPos = ReadLE32(in + 116);
+    index.nVersion = ReadLE32(in + 120);
+    index.nTime = ReadLE32(in + 124);
+    index.nBits = ReadLE32(in + 128);
+    index.nNonce = ReadLE32(in + 132);
+}
+
+/** Read-only view of a whole file, memory-mapped where the platform allows it. */
+class ReadOnlyFile
+{
+public:
+    explicit ReadOnlyFile(const fs::path& path)
+    {
+#ifndef WIN32
+        const int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd == -1) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const unsigned char*>(addr);
+                m_size = st.st_size;
+            }
+        }
+        close(fd);
+#else
+        FILE* file = fsbridge::fopen(path, "rb");
+        if (!file) return;
+        unsigned char buf[65536];
+        size_t read;
+        while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+            m_buffer.insert(m_buffer.end(), buf, buf + read);
+        }
+        fclose(file);
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+#endif
+    }
+
+    ~ReadOnlyFile()
+    {
+#ifndef WIN32
+        if (m_data) munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+    }
+
+    ReadOnlyFile(const ReadOnlyFile&) = delete;
+    ReadOnlyFile& operator=(const ReadOnlyFile&) = delete;
+
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const unsigned char* m_data{nullptr};
+    size_t m_size{0};
+#ifdef WIN32
+    std::vector<unsigned char> m_buffer;
+#endif
+};
+
+} // namespace
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const fs::path& path, const std::vector<const CBlockIndex*>& entries)
+{
+    // Drop the record of any previous snapshot before the file is replaced.
+    if (!Erase(DB_BLOCK_INDEX_SNAPSHOT, true)) {
+        return error("%s: failed to update the block database", __func__);
+    }
+
+    const fs::path temp_path = path.string() + ".new";
+    FILE* file = fsbridge::fopen(temp_path, "wb");
+    if (!file) {
+        return error("%s: failed to open %s", __func__, temp_path.string());
+    }
+    unsigned char header[BLOCK_INDEX_SNAPSHOT_HEADER_SIZE];
+    memcpy(header, BLOCK_INDEX_SNAPSHOT_MAGIC, 4);
+    WriteLE32(header + 4, BLOCK_INDEX_SNAPSHOT_VERSION);
+    WriteLE64(header + 8, entries.size());
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+    CSHA256 hasher;
+    unsigned char record[BLOCK_INDEX_SNAPSHOT_RECORD_SIZE];
+    for (auto it = entries.begin(); ok && it != entries.end(); ++it) {
+        EncodeSnapshotRecord(**it, record);
+        hasher.Write(record, sizeof(record));
+        ok = fwrite(record, sizeof(record), 1, file) == 1;
+    }
+    ok = ok && FileCommit(file);
+    fclose(file);
+    if (!ok || !RenameOver(temp_path, path)) {
+        fs::remove(temp_path);
+        return error("%s: failed to write %s", __func__, path.string());
+    }
+
+    uint256 checksum;
+    hasher.Finalize(checksum.begin());
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, std::make_pair(uint64_t{entries.size()}, checksum), true);
+}
+
+bool CBlockTreeDB::LoadBlockIndexSnapshot(const fs::path& path, const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    std::pair<uint64_t, uint256> expected;
+    if (!Read(DB_BLOCK_INDEX_SNAPSHOT, expected)) {
+        LogPrintf("No block index snapshot matching the block database\n");
+        return false;
+    }
+
+    ReadOnlyFile file(path);
+    const unsigned char* data = file.data();
+    if (!data || file.size() < BLOCK_INDEX_SNAPSHOT_HEADER_SIZE ||
+        memcmp(data, BLOCK_INDEX_SNAPSHOT_MAGIC, 4) != 0 ||
+        ReadLE32(data + 4) != BLOCK_INDEX_SNAPSHOT_VERSION ||
+        ReadLE64(data + 8) != expected.first ||
+        (file.size() - BLOCK_INDEX_SNAPSHOT_HEADER_SIZE) / BLOCK_INDEX_SNAPSHOT_RECORD_SIZE != expected.first ||
+        (file.size() - BLOCK_INDEX_SNAPSHOT_HEADER_SIZE) % BLOCK_INDEX_SNAPSHOT_RECORD_SIZE != 0) {
+        LogPrintf("Block index snapshot %s is missing or does not match the block database\n", path.string());
+        return false;
+    }
+    const size_t count = expected.first;
+    const unsigned char* records = data + BLOCK_INDEX_SNAPSHOT_HEADER_SIZE;
+
+    uint256 checksum;
+    CSHA256().Write(records, count * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE).Finalize(checksum.begin());
+    if (checksum != expected.second) {
+        LogPrintf("Block index snapshot %s is corrupted\n", path.string());
+        return false;
+    }
+
+    // The stored hashes are covered by the checksum, so rather than hashing
+    // every header again only their proof of work is checked. That is done
+    // for all records before any of them is inserted.
+    std::atomic<bool> pow_ok{true};
+    ForEachRangeInParallel(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && pow_ok; ++i) {
+            uint256 hash;
+            CDiskBlockIndex diskindex;
+            DecodeSnapshotRecord(records + i * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE, hash, diskindex);
+            if (diskindex.nHeight != 0 && !CheckProofOfWork(hash, diskindex.nBits, consensusParams)) {
+                pow_ok = false;
+            }
+        }
+    });
+    if (!pow_ok) {
+        LogPrintf("Block index snapshot %s contains an entry with invalid proof of work\n", path.string());
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint256 hash;
+        CDiskBlockIndex diskindex;
+        DecodeSnapshotRecord(records + i * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE, hash, diskindex);
+        if (!InsertDiskBlockIndex(diskindex, hash, consensusParams, insertBlockIndex)) return false;
+    }
+    return true;
+}
+
+namespace {
+
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
 class CCoins
 {
@@ -9,10 +9,16 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <fs.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -38,6 +44,18 @@ static const int64_t nMaxTxIndexCache = 1024;
 static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -utxoprefetchthreads default
+static const int DEFAULT_UTXO_PREFETCH_THREADS = 4;
+//! max. -utxoprefetchthreads
+static const int MAX_UTXO_PREFETCH_THREADS = 16;
+//! Max number of coins held by the prefetch staging layer
+static const size_t MAX_PREFETCH_STAGED_COINS = 200000;
+//! Number of outpoints looked up by a prefetch thread in one go
+static const size_t PREFETCH_BATCH_SIZE = 64;
+//! Max number of threads hashing block index records at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Number of block index records read from the database before they are hashed and inserted
+static const size_t BLOCK_INDEX_LOAD_BATCH_SIZE = 16384;
 
 // Actually declared in validation.cpp; can't include because of circular dependency.
 extern RecursiveMutex cs_main;
@@ -59,7 +77,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) override;
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
@@ -70,6 +88,115 @@ public:
     void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
+/**
+ * Staging layer between the in-memory coins cache and the coin database.
+ *
+ * The inputs of blocks that are about to be connected are looked up by a pool
+ * of background threads, in sorted batches, and parked here. Cache misses in
+ * ConnectBlock are then mostly served from memory instead of costing one
+ * synchronous leveldb read each. A staged coin is handed out once and then
+ * lives in the cache above.
+ *
+ * All staged coins are dropped whenever the database is written to, and
+ * lookups that were in flight during a write are discarded, so a staged coin
+ * always matches what the database would have returned.
+ */
+class CCoinsViewPrefetch final : public CCoinsViewBacked
+{
+public:
+    //! With zero threads this is a pass-through view.
+    CCoinsViewPrefetch(CCoinsView* view, int threads);
+    ~CCoinsViewPrefetch();
+
+    /**
+     * Queue lookups for the inputs of the block that were not created in the
+     * block itself. If cache is given (and its lock is held by the caller),
+     * inputs it already holds are skipped.
+     */
+    void PrefetchInputs(const CBlock& block, const CCoinsViewCache* cache = nullptr);
+
+    /** Discard queued lookups and wait for the ones in flight to finish. */
+    void Drain();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override;
+
+    size_t GetStagedCount() const;
+
+private:
+    void ThreadLookup();
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::vector<COutPoint>> m_queue GUARDED_BY(m_mutex);
+    mutable std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> m_staged GUARDED_BY(m_mutex);
+    //! Bumped around every database write to invalidate lookups in flight.
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+    //! Number of batches being looked up right now.
+    int m_busy GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    mutable uint64_t m_hits GUARDED_BY(m_mutex){0};
+    mutable uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    std::vector<std::thread> m_threads;
+};
+
+/**
+ * Layer that writes to the coin database on a background thread.
+ *
+ * BatchWrite copies the dirty entries it is given (or takes them over, if it
+ * may erase them) and returns right away, so the caller does not have to hold
+ * cs_main while leveldb works through them. Until the write has finished,
+ * lookups of those coins are answered from the copy, so the views above see
+ * the new state all along.
+ *
+ * Only one write is in progress at a time: a BatchWrite arriving while the
+ * previous one is still being written waits for it first. The database
+ * records the transition in DB_HEAD_BLOCKS as with synchronous writes, so a
+ * crash during a background write is recovered from the same way.
+ *
+ * Views that read the database directly, bypassing this layer, have to call
+ * Sync() first.
+ */
+class CCoinsViewAsyncWriter final : public CCoinsViewBacked
+{
+public:
+    explicit CCoinsViewAsyncWriter(CCoinsView* view);
+    //! Finishes the write in progress, if any.
+    ~CCoinsViewAsyncWriter();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override;
+
+    /**
+     * Wait until everything handed to BatchWrite is in the database.
+     * @returns false if a background write failed, in which case the state
+     *     of the database is undefined.
+     */
+    bool Sync();
+
+    //! Number of coins waiting to be written.
+    size_t GetPendingCount() const;
+
+private:
+    void ThreadWrite();
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Dirty entries of the write in progress. Only changed while m_writing
+    //! is false, the writer thread iterates it without holding m_mutex.
+    CCoinsMap m_pending GUARDED_BY(m_mutex);
+    uint256 m_pending_block GUARDED_BY(m_mutex);
+    bool m_writing GUARDED_BY(m_mutex){false};
+    bool m_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    std::thread m_thread;
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -106,6 +233,19 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+
+    /**
+     * Write entries to a flat snapshot file at path and record its checksum
+     * in the database. The record is dropped by the next WriteBatchSync, so
+     * the snapshot is only used while it still matches the database.
+     */
+    bool WriteBlockIndexSnapshot(const fs::path& path, const std::vector<const CBlockIndex*>& entries);
+    /**
+     * Load the block index from the snapshot file at path. Returns false
+     * without loading anything if there is no snapshot matching the
+     * database, in which case LoadBlockIndexGuts should be used instead.
+     */
+    bool LoadBlockIndexSnapshot(const fs::path& path, const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
 #endif // BADDCOIN_TXDB_H
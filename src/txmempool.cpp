@@ -14,11 +14,14 @@
 #include <policy/fees.h>
 #include <policy/settings.h>
 #include <reverse_iterator.h>
+#include <util/memory.h>
 #include <util/system.h>
 #include <util/moneystr.h>
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <algorithm>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
@@ -37,6 +40,28 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSigOpCostWithAncestors = sigOpCost;
 }
 
+void CTxMemPoolCluster::UpdateChunks()
+{
+    chunks.clear();
+    for (size_t i = 0; i < txs.size(); ++i) {
+        Chunk chunk{i + 1, txs[i]->GetModifiedFee(), txs[i]->GetTxSize(), txs[i]->GetSigOpCost()};
+        // A transaction paying a better feerate than the chunks before it is
+        // worth mining together with them, so fold them into its chunk.
+        while (!chunks.empty() && chunk.HasHigherFeerate(chunks.back())) {
+            chunk.fee += chunks.back().fee;
+            chunk.size += chunks.back().size;
+            chunk.sigops += chunks.back().sigops;
+            chunks.pop_back();
+        }
+        chunks.push_back(chunk);
+    }
+}
+
+size_t CTxMemPoolCluster::DynamicMemoryUsage() const
+{
+    return memusage::MallocUsage(sizeof(CTxMemPoolCluster)) + memusage::DynamicUsage(txs) + memusage::DynamicUsage(chunks);
+}
+
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 {
     nModFeesWithDescendants += newFeeDelta - feeDelta;
@@ -59,8 +84,11 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    CTxMemPoolEntry::Children stageEntries, descendants;
-    stageEntries = updateIt->GetMemPoolChildrenConst();
+    // A reorg can leave a transaction with many more descendants than the
+    // mempool limits allow, so these are not kept as sorted vectors.
+    std::set<CTxMemPoolEntry::CTxMemPoolEntryRef, CompareIteratorByHash> stageEntries, descendants;
+    const CTxMemPoolEntry::Children& updateChildren = updateIt->GetMemPoolChildrenConst();
+    stageEntries.insert(updateChildren.begin(), updateChildren.end());
 
     while (!stageEntries.empty()) {
         const CTxMemPoolEntry& descendant = *stageEntries.begin();
@@ -116,6 +144,9 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // accounted for in the state of their ancestors)
     std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
 
+    // Transactions that gained children, whose clusters need a new order.
+    std::vector<txiter> relinked;
+
     // Iterate in reverse, so that whenever we are looking at a transaction
     // we are sure that all in-mempool descendants have already been processed.
     // This maximizes the benefit of the descendant cache and guarantees that
@@ -142,11 +173,21 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
                     UpdateChild(it, childIter, true);
                     UpdateParent(childIter, it, true);
+                    MergeClusters(it->m_cluster, childIter->m_cluster);
+                    relinked.push_back(it);
                 }
             }
         } // release epoch guard for UpdateForDescendants
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+
+    std::set<CTxMemPoolCluster*> clusters;
+    for (txiter it : relinked) {
+        clusters.insert(it->m_cluster);
+    }
+    for (CTxMemPoolCluster* cluster : clusters) {
+        RelinearizeCluster(cluster);
+    }
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -332,7 +373,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
-    : nTransactionsUpdated(0), minerPolicyEstimator(estimator), m_epoch(0), m_has_epoch_guard(false)
+    : nTransactionsUpdated(0), minerPolicyEstimator(estimator), m_epoch(0), m_has_epoch_guard(false),
+      mapTx(indexed_transaction_set::ctor_args_list(), indexed_transaction_set::allocator_type(&m_entry_pool))
 {
     _clear(); //lock free clear
 
@@ -398,10 +440,11 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
+    AddToCluster(newit);
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
-    if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
+    if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(*newit, validFeeEstimate);}
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
@@ -434,7 +477,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+    cachedInnerUsage -= it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -588,6 +631,7 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
+    m_clusters.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -636,7 +680,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        innerUsage += memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+        innerUsage += it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
         bool fDependsWait = false;
         CTxMemPoolEntry::Parents setParentCheck;
         for (const CTxIn &txin : tx.vin) {
@@ -662,6 +706,11 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         };
         assert(setParentCheck.size() == it->GetMemPoolParentsConst().size());
         assert(std::equal(setParentCheck.begin(), setParentCheck.end(), it->GetMemPoolParentsConst().begin(), comp));
+        // Check that the transaction shares its parents' cluster.
+        assert(it->m_cluster && it->m_cluster->index < m_clusters.size() && m_clusters[it->m_cluster->index].get() == it->m_cluster);
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            assert(parent.m_cluster == it->m_cluster);
+        }
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -727,6 +776,50 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    // Check that each cluster is connected, linearized and correctly chunked.
+    size_t clusterTxs = 0;
+    for (const auto& cluster : m_clusters) {
+        assert(!cluster->txs.empty());
+        std::set<const CTxMemPoolEntry*> seen;
+        for (const CTxMemPoolEntry* entry : cluster->txs) {
+            assert(entry->m_cluster == cluster.get());
+            for (const CTxMemPoolEntry& parent : entry->GetMemPoolParentsConst()) {
+                assert(seen.count(&parent));
+            }
+            assert(seen.insert(entry).second);
+        }
+        std::set<const CTxMemPoolEntry*> reached{cluster->txs.front()};
+        std::vector<const CTxMemPoolEntry*> todo{cluster->txs.front()};
+        while (!todo.empty()) {
+            const CTxMemPoolEntry* entry = todo.back();
+            todo.pop_back();
+            for (const CTxMemPoolEntry& parent : entry->GetMemPoolParentsConst()) {
+                if (reached.insert(&parent).second) todo.push_back(&parent);
+            }
+            for (const CTxMemPoolEntry& child : entry->GetMemPoolChildrenConst()) {
+                if (reached.insert(&child).second) todo.push_back(&child);
+            }
+        }
+        assert(reached == seen);
+        size_t begin = 0;
+        for (size_t i = 0; i < cluster->chunks.size(); ++i) {
+            const CTxMemPoolCluster::Chunk& chunk = cluster->chunks[i];
+            assert(chunk.end > begin && chunk.end <= cluster->txs.size());
+            CAmount fee = 0;
+            uint64_t size = 0;
+            for (size_t j = begin; j < chunk.end; ++j) {
+                fee += cluster->txs[j]->GetModifiedFee();
+                size += cluster->txs[j]->GetTxSize();
+            }
+            assert(chunk.fee == fee && chunk.size == size);
+            assert(i == 0 || !chunk.HasHigherFeerate(cluster->chunks[i - 1]));
+            begin = chunk.end;
+        }
+        assert(begin == cluster->txs.size());
+        clusterTxs += cluster->txs.size();
+    }
+    assert(clusterTxs == mapTx.size());
+
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
@@ -790,7 +883,7 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid) const
 }
 
 static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
-    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), it->GetFee(), it->GetTxSize(), it->GetModifiedFee() - it->GetFee()};
+    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), it->GetFee(), it->GetTxSize(), it->GetModifiedFee() - it->GetFee(), it->GetSigOpCost()};
 }
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
@@ -851,6 +944,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            RelinearizeCluster(it->m_cluster);
             ++nTransactionsUpdated;
         }
     }
@@ -924,8 +1018,15 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // Each node of mapTx takes exactly one block of the pool it is allocated from. Free
+    // blocks in the pool are not counted, as they are reused for new transactions.
+    // The bucket arrays of the two hashed indexes are estimated at two pointers per transaction.
+    typedef indexed_transaction_set::final_node_type node_type;
+    const size_t nodeUsage = PoolResource::PooledBlockSizeBytes(sizeof(node_type), alignof(node_type)) + 2 * sizeof(void*);
+    static_assert(sizeof(node_type) <= PoolResource::MAX_BLOCK_SIZE_BYTES, "mempool entries must be allocated from the pool");
+    // Clusters are estimated by one linearization slot and one chunk per transaction.
+    const size_t clusterUsage = memusage::DynamicUsage(m_clusters) + memusage::MallocUsage(sizeof(CTxMemPoolCluster)) * m_clusters.size() + (sizeof(const CTxMemPoolEntry*) + sizeof(CTxMemPoolCluster::Chunk)) * mapTx.size();
+    return nodeUsage * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + clusterUsage + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked) {
@@ -940,9 +1041,24 @@ void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked)
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
     UpdateForRemoveFromMempool(stage, updateDescendants);
+    // Take the staged transactions out of their clusters' linearizations
+    // before the entries go away; the clusters are split once the links to
+    // the removed transactions have been severed.
+    std::set<CTxMemPoolCluster*> clusters;
+    for (txiter it : stage) {
+        clusters.insert(it->m_cluster);
+    }
+    for (CTxMemPoolCluster* cluster : clusters) {
+        cluster->txs.erase(std::remove_if(cluster->txs.begin(), cluster->txs.end(), [&](const CTxMemPoolEntry* entry) {
+            return stage.count(mapTx.iterator_to(*entry)) != 0;
+        }), cluster->txs.end());
+    }
     for (txiter it : stage) {
         removeUnchecked(it, reason);
     }
+    for (CTxMemPoolCluster* cluster : clusters) {
+        UpdateClusterForRemoval(cluster);
+    }
 }
 
 int CTxMemPool::Expire(std::chrono::seconds time)
@@ -974,23 +1090,193 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Children s;
-    if (add && entry->GetMemPoolChildren().insert(*child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolChildren().erase(*child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Children& children = entry->GetMemPoolChildren();
+    cachedInnerUsage -= children.DynamicMemoryUsage();
+    if (add) {
+        children.insert(*child);
+    } else {
+        children.erase(*child);
     }
+    cachedInnerUsage += children.DynamicMemoryUsage();
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Parents s;
-    if (add && entry->GetMemPoolParents().insert(*parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolParents().erase(*parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Parents& parents = entry->GetMemPoolParents();
+    cachedInnerUsage -= parents.DynamicMemoryUsage();
+    if (add) {
+        parents.insert(*parent);
+    } else {
+        parents.erase(*parent);
+    }
+    cachedInnerUsage += parents.DynamicMemoryUsage();
+}
+
+CTxMemPoolCluster* CTxMemPool::NewCluster()
+{
+    AssertLockHeld(cs);
+    m_clusters.push_back(MakeUnique<CTxMemPoolCluster>());
+    m_clusters.back()->index = m_clusters.size() - 1;
+    return m_clusters.back().get();
+}
+
+void CTxMemPool::DeleteCluster(CTxMemPoolCluster* cluster)
+{
+    AssertLockHeld(cs);
+    const size_t index = cluster->index;
+    if (index + 1 != m_clusters.size()) {
+        m_clusters[index] = std::move(m_clusters.back());
+        m_clusters[index]->index = index;
+    }
+    m_clusters.pop_back();
+}
+
+CTxMemPoolCluster* CTxMemPool::MergeClusters(CTxMemPoolCluster* a, CTxMemPoolCluster* b)
+{
+    AssertLockHeld(cs);
+    if (a == b) return a;
+    if (a->txs.size() < b->txs.size()) std::swap(a, b);
+    // Neither cluster depends on the other, so any interleaving of their
+    // linearizations is valid; taking whole chunks best-first keeps both
+    // chunkings intact.
+    std::vector<const CTxMemPoolEntry*> txs;
+    txs.reserve(a->txs.size() + b->txs.size());
+    size_t chunk_a = 0, chunk_b = 0;
+    while (chunk_a < a->chunks.size() || chunk_b < b->chunks.size()) {
+        const bool take_a = chunk_b == b->chunks.size() ||
+            (chunk_a < a->chunks.size() && !b->chunks[chunk_b].HasHigherFeerate(a->chunks[chunk_a]));
+        const CTxMemPoolCluster* from = take_a ? a : b;
+        size_t& chunk = take_a ? chunk_a : chunk_b;
+        const size_t begin = chunk == 0 ? 0 : from->chunks[chunk - 1].end;
+        txs.insert(txs.end(), from->txs.begin() + begin, from->txs.begin() + from->chunks[chunk].end);
+        ++chunk;
+    }
+    for (const CTxMemPoolEntry* entry : b->txs) {
+        entry->m_cluster = a;
+    }
+    a->txs = std::move(txs);
+    a->UpdateChunks();
+    DeleteCluster(b);
+    return a;
+}
+
+void CTxMemPool::AddToCluster(txiter it)
+{
+    AssertLockHeld(cs);
+    CTxMemPoolCluster* cluster = nullptr;
+    for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+        cluster = cluster ? MergeClusters(cluster, parent.m_cluster) : parent.m_cluster;
+    }
+    if (!cluster) {
+        cluster = NewCluster();
+    }
+    // Without in-mempool children the transaction can go last; chunking then
+    // merges it with any parents it pays for.
+    it->m_cluster = cluster;
+    cluster->txs.push_back(&*it);
+    cluster->UpdateChunks();
+}
+
+void CTxMemPool::UpdateClusterForRemoval(CTxMemPoolCluster* cluster)
+{
+    AssertLockHeld(cs);
+    if (cluster->txs.empty()) {
+        DeleteCluster(cluster);
+        return;
+    }
+    // Label the connected components of what is left, numbered in order of
+    // their first transaction in the linearization.
+    std::map<const CTxMemPoolEntry*, size_t> component;
+    std::vector<const CTxMemPoolEntry*> todo;
+    size_t components = 0;
+    for (const CTxMemPoolEntry* entry : cluster->txs) {
+        if (!component.emplace(entry, components).second) continue;
+        todo.push_back(entry);
+        while (!todo.empty()) {
+            const CTxMemPoolEntry* next = todo.back();
+            todo.pop_back();
+            for (const CTxMemPoolEntry& parent : next->GetMemPoolParentsConst()) {
+                if (component.emplace(&parent, components).second) todo.push_back(&parent);
+            }
+            for (const CTxMemPoolEntry& child : next->GetMemPoolChildrenConst()) {
+                if (component.emplace(&child, components).second) todo.push_back(&child);
+            }
+        }
+        ++components;
+    }
+    if (components > 1) {
+        // Every component inherits its part of the existing order, which
+        // remains valid as no dependencies were added.
+        std::vector<CTxMemPoolCluster*> split{cluster};
+        while (split.size() < components) {
+            split.push_back(NewCluster());
+        }
+        std::vector<const CTxMemPoolEntry*> txs;
+        txs.swap(cluster->txs);
+        for (const CTxMemPoolEntry* entry : txs) {
+            CTxMemPoolCluster* target = split[component[entry]];
+            target->txs.push_back(entry);
+            entry->m_cluster = target;
+        }
+        for (CTxMemPoolCluster* part : split) {
+            part->UpdateChunks();
+        }
+    } else {
+        cluster->UpdateChunks();
+    }
+}
+
+void CTxMemPool::RelinearizeCluster(CTxMemPoolCluster* cluster)
+{
+    AssertLockHeld(cs);
+    std::vector<const CTxMemPoolEntry*>& txs = cluster->txs;
+    // A transaction has more ancestors than any of its ancestors, so this
+    // order is always valid.
+    std::stable_sort(txs.begin(), txs.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    if (txs.size() > 1 && txs.size() <= MAX_CLUSTER_RELINEARIZE_SIZE) {
+        // Repeatedly pick the transaction whose not yet picked ancestors
+        // have the best combined feerate, and emit those ancestors.
+        const size_t n = txs.size();
+        std::map<const CTxMemPoolEntry*, size_t> position;
+        std::vector<uint64_t> ancestors(n);
+        for (size_t i = 0; i < n; ++i) {
+            position.emplace(txs[i], i);
+            ancestors[i] = uint64_t{1} << i;
+            for (const CTxMemPoolEntry& parent : txs[i]->GetMemPoolParentsConst()) {
+                ancestors[i] |= ancestors[position.at(&parent)];
+            }
+        }
+        std::vector<const CTxMemPoolEntry*> order;
+        order.reserve(n);
+        uint64_t remaining = n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+        while (remaining) {
+            uint64_t best = 0;
+            CTxMemPoolCluster::Chunk best_chunk{0, 0, 0, 0};
+            for (size_t i = 0; i < n; ++i) {
+                if (!(remaining >> i & 1)) continue;
+                const uint64_t set = ancestors[i] & remaining;
+                CTxMemPoolCluster::Chunk chunk{0, 0, 0, 0};
+                for (size_t j = 0; j < n; ++j) {
+                    if (!(set >> j & 1)) continue;
+                    chunk.fee += txs[j]->GetModifiedFee();
+                    chunk.size += txs[j]->GetTxSize();
+                }
+                if (!best || chunk.HasHigherFeerate(best_chunk)) {
+                    best = set;
+                    best_chunk = chunk;
+                }
+            }
+            for (size_t j = 0; j < n; ++j) {
+                if (best >> j & 1) order.push_back(txs[j]);
+            }
+            remaining &= ~best;
+        }
+        txs = std::move(order);
     }
+    cluster->UpdateChunks();
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -6,8 +6,10 @@
 #ifndef BADDCOIN_TXMEMPOOL_H
 #define BADDCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -17,11 +19,13 @@
 #include <coins.h>
 #include <crypto/siphash.h>
 #include <indirectmap.h>
+#include <memusage.h>
 #include <optional.h>
 #include <policy/feerate.h>
 #include <primitives/transaction.h>
 #include <sync.h>
 #include <random.h>
+#include <support/allocators/pool.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -33,6 +37,12 @@ extern RecursiveMutex cs_main;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Largest cluster that is fully re-linearized by ancestor feerate when its
+ *  order cannot be patched incrementally; larger ones are ordered by ancestor
+ *  count instead. Must not exceed 64 (the linearization uses 64-bit masks). */
+static const unsigned int MAX_CLUSTER_RELINEARIZE_SIZE = 64;
+
+struct CTxMemPoolCluster;
 
 struct LockPoints
 {
@@ -63,6 +73,53 @@ struct CompareIteratorByHash {
         return a->GetTx().GetHash() < b->GetTx().GetHash();
     }
 };
+/**
+ * Set kept as a sorted vector, for the in-mempool parents and children of an
+ * entry. Most transactions have only one or two of each, and a std::set
+ * spends a separate allocation with three pointers of overhead on each
+ * element. Only the part of the std::set interface the mempool uses is
+ * provided.
+ */
+template <typename T, typename Compare>
+class SortedVectorSet
+{
+    std::vector<T> m_elems;
+
+public:
+    typedef typename std::vector<T>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    const_iterator begin() const { return m_elems.begin(); }
+    const_iterator end() const { return m_elems.end(); }
+    size_t size() const { return m_elems.size(); }
+    bool empty() const { return m_elems.empty(); }
+
+    std::pair<const_iterator, bool> insert(const T& elem)
+    {
+        auto it = std::lower_bound(m_elems.begin(), m_elems.end(), elem, Compare());
+        if (it != m_elems.end() && !Compare()(elem, *it)) return {it, false};
+        return {m_elems.insert(it, elem), true};
+    }
+
+    size_t erase(const T& elem)
+    {
+        auto it = std::lower_bound(m_elems.begin(), m_elems.end(), elem, Compare());
+        if (it == m_elems.end() || Compare()(elem, *it)) return 0;
+        m_elems.erase(it);
+        // Give the memory back, as a std::set would, so that entries whose
+        // children were mined do not hold on to it.
+        m_elems.shrink_to_fit();
+        return 1;
+    }
+
+    size_t count(const T& elem) const
+    {
+        return std::binary_search(m_elems.begin(), m_elems.end(), elem, Compare());
+    }
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(m_elems); }
+};
+
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
@@ -80,8 +137,8 @@ class CTxMemPoolEntry
 public:
     typedef std::reference_wrapper<const CTxMemPoolEntry> CTxMemPoolEntryRef;
     // two aliases, should the types ever diverge
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
+    typedef SortedVectorSet<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
+    typedef SortedVectorSet<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
 
 private:
     const CTransactionRef tx;
@@ -156,6 +213,49 @@ public:
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
+    mutable CTxMemPoolCluster* m_cluster{nullptr}; //!< Cluster this transaction belongs to
+};
+
+/** \class CTxMemPoolCluster
+ *
+ * A cluster is a connected component of the mempool's dependency graph: all
+ * transactions linked to each other through any chain of in-mempool parents
+ * and children. Every mempool transaction belongs to exactly one cluster.
+ *
+ * A cluster keeps its transactions in a linearization, an order in which each
+ * transaction comes after its in-mempool parents, together with the chunks of
+ * that order: runs of consecutive transactions whose combined feerates never
+ * increase from one chunk to the next. Taking a cluster's chunks in order
+ * collects its fees as early as possible, and the best chunk left anywhere in
+ * the mempool is always the first remaining chunk of some cluster, so a block
+ * template is a merge of the clusters' chunk lists.
+ *
+ * Clusters are maintained incrementally. A new transaction is appended to the
+ * merged clusters of its parents, and removing transactions splits what is
+ * left into its connected components without reordering it.
+ */
+struct CTxMemPoolCluster
+{
+    struct Chunk {
+        size_t end;     //!< Index one past the chunk's last transaction in txs
+        CAmount fee;    //!< Total modified fees of the chunk
+        uint64_t size;  //!< ... and virtual size
+        int64_t sigops; //!< ... and sigop cost
+
+        bool HasHigherFeerate(const Chunk& other) const
+        {
+            // Compare in floating point to avoid overflow, like the mempool indexes do
+            return (double)fee * other.size > (double)other.fee * size;
+        }
+    };
+
+    std::vector<const CTxMemPoolEntry*> txs; //!< Linearization of the cluster
+    std::vector<Chunk> chunks;               //!< Chunks of txs, best feerate first
+    size_t index;                            //!< Index in the mempool's cluster list
+
+    /** Recompute the chunks of the current linearization. */
+    void UpdateChunks();
+    size_t DynamicMemoryUsage() const;
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -384,6 +484,9 @@ struct TxMempoolInfo
 
     /** The fee delta. */
     int64_t nFeeDelta;
+
+    /** Sigop cost of the transaction. */
+    int64_t sigop_cost;
 };
 
 /** Reason why a transaction was removed from the mempool,
@@ -434,14 +537,18 @@ public:
  * - time in mempool
  * - ancestor feerate [we use min(feerate of tx, feerate of tx with all unconfirmed ancestors)]
  *
+ * Its nodes, each holding an entry and the links of all five indexes, are
+ * allocated from m_entry_pool rather than one by one from the heap.
+ *
  * Note: the term "descendant" refers to in-mempool transactions that depend on
  * this one, while "ancestor" refers to in-mempool transactions that a given
  * transaction depends on.
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * the set of in-mempool direct parents and direct children in each
+ * CTxMemPoolEntry.  Within each CTxMemPoolEntry, we also track the size and
+ * fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
@@ -449,6 +556,8 @@ public:
  * - update a new entry's setMemPoolParents to include all in-mempool parents
  * - update the new entry's direct parents to include the new tx as a child
  * - update all ancestors of the transaction to include the new tx's size/fee
+ * - append the new tx to the (merged) cluster of its parents, see
+ *   CTxMemPoolCluster
  *
  * When a transaction is removed from the mempool, we must:
  * - update all in-mempool parents to not track the tx in setMemPoolChildren
@@ -538,7 +647,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        PoolAllocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     /**
@@ -569,6 +679,8 @@ public:
      * the mempool is consistent with the new chain tip and fully populated.
      */
     mutable RecursiveMutex cs;
+    //! Storage for the nodes of mapTx, which are allocated from large chunks
+    PoolResource m_entry_pool GUARDED_BY(cs);
     indexed_transaction_set mapTx GUARDED_BY(cs);
 
     using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
@@ -586,6 +698,9 @@ private:
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** All clusters, in no particular order; see CTxMemPoolCluster::index */
+    std::vector<std::unique_ptr<CTxMemPoolCluster>> m_clusters GUARDED_BY(cs);
+
     /**
      * track locally submitted transactions to periodically retry initial broadcast
      * map of txid -> wtxid
@@ -651,6 +766,13 @@ public:
     /** Translate a set of hashes into a set of pool iterators to avoid repeated lookups */
     setEntries GetIterSet(const std::set<uint256>& hashes) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** The clusters of the mempool, each with its chunks in feerate order */
+    const std::vector<std::unique_ptr<CTxMemPoolCluster>>& GetClusters() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        AssertLockHeld(cs);
+        return m_clusters;
+    }
+
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
      *  also be in the set, unless this transaction is being removed for being
@@ -813,6 +935,21 @@ private:
      *  removal.
      */
     void removeUnchecked(txiter entry, MemPoolRemovalReason reason) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    CTxMemPoolCluster* NewCluster() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void DeleteCluster(CTxMemPoolCluster* cluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Merge two clusters that do not depend on each other by interleaving
+     *  their chunks in feerate order. Returns the remaining cluster. */
+    CTxMemPoolCluster* MergeClusters(CTxMemPoolCluster* a, CTxMemPoolCluster* b) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Append a newly added transaction, which has no in-mempool children,
+     *  to the clusters of its parents. */
+    void AddToCluster(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Split what is left of a cluster after removals into its connected
+     *  components, keeping the existing order. */
+    void UpdateClusterForRemoval(CTxMemPoolCluster* cluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Compute a new linearization for a cluster, for when its order is no
+     *  longer valid (new links after a reorg) or its fees have changed. */
+    void RelinearizeCluster(CTxMemPoolCluster* cluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
 public:
     /** EpochGuard: RAII-style guard for using epoch-based graph traversal algorithms.
      *     When walking ancestors or descendants, we generally want to avoid
@@ -132,6 +132,11 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+unsigned int g_connect_pipeline_depth{0};
+int g_utxo_prefetch_threads{0};
+int g_dbcache_retain{DEFAULT_DBCACHE_RETAIN};
+bool g_block_index_snapshot{DEFAULT_BLOCK_INDEX_SNAPSHOT};
+bool g_batch_signature_checks{DEFAULT_BATCH_SIGNATURE_CHECKS};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -480,6 +485,17 @@ public:
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Single transaction acceptance that verifies scripts without holding
+    // cs_main. The inputs are looked up under the lock, the scripts are
+    // checked against that snapshot, and the contextual checks are redone
+    // under a second, short critical section before the transaction is added.
+    bool AcceptSingleTransactionConcurrent(const CTransactionRef& ptx, ATMPArgs& args) LOCKS_EXCLUDED(cs_main);
+
+    // Single transaction acceptance for a transaction that was in the mempool
+    // when it was dumped at the current tip. The scripts are skipped if the
+    // fee and sigop cost still match the recorded ones.
+    bool AcceptTrustedTransaction(const CTransactionRef& ptx, ATMPArgs& args, CAmount expected_fee, int64_t expected_sigop_cost) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -499,6 +515,10 @@ private:
         const uint256& m_hash;
     };
 
+    // Run the checks that only depend on the transaction itself: consensus
+    // sanity, standardness and size. Needs no locks.
+    bool StatelessChecks(ATMPArgs& args, Workspace& ws);
+
     // Run the policy checks on a given transaction, excluding any script checks.
     // Looks up inputs, calculates feerate, considers replacement, evaluates
     // package limits, etc. As this function can be invoked for "free" by a peer,
@@ -507,7 +527,8 @@ private:
 
     // Run the script checks using our policy flags. As this can be slow, we should
     // only invoke this on transactions that have otherwise passed policy checks.
-    bool PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    // Only reads the inputs cached in m_view, so it needs no locks.
+    bool PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata);
 
     // Re-run the script checks, using consensus flags, and try to cache the
     // result in the scriptcache. This should be done after
@@ -549,28 +570,10 @@ private:
     size_t m_limit_descendant_size;
 };
 
-bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
+bool MemPoolAccept::StatelessChecks(ATMPArgs& args, Workspace& ws)
 {
-    const CTransactionRef& ptx = ws.m_ptx;
     const CTransaction& tx = *ws.m_ptx;
-    const uint256& hash = ws.m_hash;
-
-    // Copy/alias what we need out of args
     TxValidationState &state = args.m_state;
-    const int64_t nAcceptTime = args.m_accept_time;
-    const bool bypass_limits = args.m_bypass_limits;
-    const CAmount& nAbsurdFee = args.m_absurd_fee;
-    std::vector<COutPoint>& coins_to_uncache = args.m_coins_to_uncache;
-
-    // Alias what we need out of ws
-    std::set<uint256>& setConflicts = ws.m_conflicts;
-    CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
-    CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
-    std::unique_ptr<CTxMemPoolEntry>& entry = ws.m_entry;
-    bool& fReplacementTransaction = ws.m_replacement_transaction;
-    CAmount& nModifiedFees = ws.m_modified_fees;
-    CAmount& nConflictingFees = ws.m_conflicting_fees;
-    size_t& nConflictingSize = ws.m_conflicting_size;
 
     if (!CheckTransaction(tx, state)) {
         return false; // state filled in by CheckTransaction
@@ -592,6 +595,32 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     if (::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
         return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "tx-size-small");
 
+    return true;
+}
+
+bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
+{
+    const CTransactionRef& ptx = ws.m_ptx;
+    const CTransaction& tx = *ws.m_ptx;
+    const uint256& hash = ws.m_hash;
+
+    // Copy/alias what we need out of args
+    TxValidationState &state = args.m_state;
+    const int64_t nAcceptTime = args.m_accept_time;
+    const bool bypass_limits = args.m_bypass_limits;
+    const CAmount& nAbsurdFee = args.m_absurd_fee;
+    std::vector<COutPoint>& coins_to_uncache = args.m_coins_to_uncache;
+
+    // Alias what we need out of ws
+    std::set<uint256>& setConflicts = ws.m_conflicts;
+    CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
+    CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
+    std::unique_ptr<CTxMemPoolEntry>& entry = ws.m_entry;
+    bool& fReplacementTransaction = ws.m_replacement_transaction;
+    CAmount& nModifiedFees = ws.m_modified_fees;
+    CAmount& nConflictingFees = ws.m_conflicting_fees;
+    size_t& nConflictingSize = ws.m_conflicting_size;
+
     // Only accept nLockTime-using transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
     // be mined yet.
@@ -982,7 +1011,6 @@ bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, Precomp
 
 bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
 {
-    const CTransaction& tx = *ws.m_ptx;
     const uint256& hash = ws.m_hash;
     TxValidationState &state = args.m_state;
     const bool bypass_limits = args.m_bypass_limits;
@@ -1012,8 +1040,9 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     // - it isn't a BIP 125 replacement transaction (may not be widely supported)
     // - it's not being re-added during a reorg which bypasses typical mempool fee limits
     // - the node is not behind
-    // - the transaction is not dependent on any other transactions in the mempool
-    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
+    // Transactions that depend on others in the mempool are tracked at the
+    // feerate of their package.
+    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation();
 
     // Store transaction in memory
     m_pool.addUnchecked(*entry, setAncestors, validForFeeEstimation);
@@ -1034,6 +1063,8 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
     Workspace workspace(ptx);
 
+    if (!StatelessChecks(args, workspace)) return false;
+
     if (!PreChecks(args, workspace)) return false;
 
     // Only compute the precomputed transaction data if we need to verify
@@ -1056,6 +1087,93 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     return true;
 }
 
+bool MemPoolAccept::AcceptSingleTransactionConcurrent(const CTransactionRef& ptx, ATMPArgs& args)
+{
+    AssertLockNotHeld(cs_main);
+
+    Workspace workspace(ptx);
+
+    if (!StatelessChecks(args, workspace)) return false;
+
+    // Look up the inputs. Afterwards m_view holds every coin the transaction
+    // spends and no longer depends on the chainstate or the mempool.
+    unsigned int consensus_flags;
+    {
+        LOCK2(cs_main, m_pool.cs);
+        if (!PreChecks(args, workspace)) return false;
+        consensus_flags = GetBlockScriptFlags(::ChainActive().Tip(), args.m_chainparams.GetConsensus());
+    }
+
+    PrecomputedTransactionData txdata;
+
+    if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+
+    // Store the result for the current consensus flags in the script
+    // execution cache, so that ConsensusScriptChecks() below is a cache hit.
+    if (!CheckInputScripts(*ptx, args.m_state, m_view, consensus_flags, /* cacheSigStore = */ true, /* cacheFullScriptStore = */ true, txdata)) {
+        return error("%s: BUG! PLEASE REPORT THIS! CheckInputScripts failed against latest-block but not STANDARD flags %s, %s",
+                __func__, ptx->GetHash().ToString(), args.m_state.ToString());
+    }
+
+    // The chain and the mempool may have changed meanwhile, so redo the
+    // contextual checks from scratch.
+    LOCK2(cs_main, m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    MemPoolAccept recheck(m_pool);
+    Workspace recheck_workspace(ptx);
+    if (!recheck.PreChecks(args, recheck_workspace)) return false;
+
+    // The scripts only need to run again if the transaction now spends
+    // different coins than the ones they were verified against.
+    for (const CTxIn& txin : ptx->vin) {
+        if (recheck.m_view.AccessCoin(txin.prevout).out != m_view.AccessCoin(txin.prevout).out) {
+            if (!recheck.PolicyScriptChecks(args, recheck_workspace, txdata)) return false;
+            break;
+        }
+    }
+
+    if (!recheck.ConsensusScriptChecks(args, recheck_workspace, txdata)) return false;
+
+    // Tx was accepted, but not added
+    if (args.m_test_accept) return true;
+
+    if (!recheck.Finalize(args, recheck_workspace)) return false;
+
+    GetMainSignals().TransactionAddedToMempool(ptx);
+
+    return true;
+}
+
+bool MemPoolAccept::AcceptTrustedTransaction(const CTransactionRef& ptx, ATMPArgs& args, CAmount expected_fee, int64_t expected_sigop_cost)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+
+    Workspace workspace(ptx);
+
+    if (!StatelessChecks(args, workspace)) return false;
+
+    if (!PreChecks(args, workspace)) return false;
+
+    // The transaction passed the script checks against this UTXO set and
+    // these flags before it was dumped. Only skip them if the fee and sigop
+    // cost found above match the record, as a guard against a damaged file.
+    if (workspace.m_entry->GetFee() != expected_fee || workspace.m_entry->GetSigOpCost() != expected_sigop_cost) {
+        PrecomputedTransactionData txdata;
+
+        if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+
+        if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+    }
+
+    if (args.m_test_accept) return true;
+
+    if (!Finalize(args, workspace)) return false;
+
+    GetMainSignals().TransactionAddedToMempool(ptx);
+
+    return true;
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
@@ -1081,6 +1199,23 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
     return res;
 }
 
+/** (try to) add a transaction from mempool.dat without checking its scripts; see LoadMempool() **/
+static bool AcceptTrustedToMemoryPool(const CChainParams& chainparams, CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
+                        int64_t nAcceptTime, CAmount expected_fee, int64_t expected_sigop_cost) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::vector<COutPoint> coins_to_uncache;
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */, coins_to_uncache, false /* test_accept */ };
+    bool res = MemPoolAccept(pool).AcceptTrustedTransaction(tx, args, expected_fee, expected_sigop_cost);
+    if (!res) {
+        // See AcceptToMemoryPoolWithTime()
+        for (const COutPoint& hashTx : coins_to_uncache)
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return res;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept)
@@ -1089,6 +1224,26 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+bool AcceptToMemoryPoolConcurrent(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
+                        std::list<CTransactionRef>* plTxnReplaced,
+                        const CAmount nAbsurdFee, bool test_accept)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<COutPoint> coins_to_uncache;
+    MemPoolAccept::ATMPArgs args { chainparams, state, GetTime(), plTxnReplaced, /* bypass_limits */ false, nAbsurdFee, coins_to_uncache, test_accept };
+    bool res = MemPoolAccept(pool).AcceptSingleTransactionConcurrent(tx, args);
+
+    LOCK(cs_main);
+    if (!res) {
+        // See AcceptToMemoryPoolWithTime()
+        for (const COutPoint& hashTx : coins_to_uncache)
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return res;
+}
+
 CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMemPool* const mempool, const uint256& hash, const Consensus::Params& consensusParams, uint256& hashBlock)
 {
     LOCK(cs_main);
@@ -1265,7 +1420,9 @@ CoinsViews::CoinsViews(
     bool in_memory,
     bool should_wipe) : m_dbview(
                             GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                        m_prefetchview(&m_dbview, g_utxo_prefetch_threads),
+                        m_writerview(&m_prefetchview),
+                        m_catcherview(&m_writerview) {}
 
 void CoinsViews::InitCache()
 {
@@ -1287,6 +1444,7 @@ void CChainState::InitCoinsDB(
         leveldb_name += "_" + m_from_snapshot_blockhash.ToString();
     }
 
+    m_block_prefetcher.reset();
     m_coins_views = MakeUnique<CoinsViews>(
         leveldb_name, cache_size_bytes, in_memory, should_wipe);
 }
@@ -1480,6 +1638,47 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
+bool CScriptCheck::RunDeferred(SignatureBatch& batch) {
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
+    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata, &batch), &error);
+}
+
+bool RunCheckBatch(std::vector<CScriptCheck>& checks)
+{
+    if (!g_batch_signature_checks || checks.size() < 2) {
+        for (CScriptCheck& check : checks) {
+            if (!check()) return false;
+        }
+        FlushSignatureCache();
+        return true;
+    }
+
+    SignatureBatch batch;
+    std::vector<std::pair<bool, size_t>> deferred;
+    deferred.reserve(checks.size());
+    for (CScriptCheck& check : checks) {
+        const bool ok = check.RunDeferred(batch);
+        deferred.emplace_back(ok, batch.size());
+    }
+    batch.Verify();
+
+    size_t begin = 0;
+    for (size_t i = 0; i < checks.size(); ++i) {
+        const size_t end = deferred[i].second;
+        if (batch.AllValid(begin, end)) {
+            // Every signature the script relied on is valid, so it ran
+            // exactly as it would have with them checked on the spot.
+            if (!deferred[i].first) return false;
+        } else if (!checks[i]()) {
+            return false;
+        }
+        begin = end;
+    }
+    FlushSignatureCache();
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1488,21 +1687,29 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
+static Mutex g_script_execution_cache_mutex;
+static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache GUARDED_BY(g_script_execution_cache_mutex);
+static uint256 g_scriptExecutionCacheNonce;
 static CSHA256 g_scriptExecutionCacheHasher;
 
-void InitScriptExecutionCache() {
-    // Setup the salted hasher
-    uint256 nonce = GetRandHash();
+static void SetScriptExecutionCacheNonce(const uint256& nonce)
+{
+    g_scriptExecutionCacheNonce = nonce;
     // We want the nonce to be 64 bytes long to force the hasher to process
     // this chunk, which makes later hash computations more efficient. We
     // just write our 32-byte entropy twice to fill the 64 bytes.
+    g_scriptExecutionCacheHasher.Reset();
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
+}
+
+void InitScriptExecutionCache() {
+    // Setup the salted hasher
+    SetScriptExecutionCacheNonce(GetRandHash());
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-    size_t nElems = g_scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    size_t nElems = WITH_LOCK(g_script_execution_cache_mutex, return g_scriptExecutionCache.setup_bytes(nMaxCacheSize));
     LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
@@ -1526,7 +1733,7 @@ void InitScriptExecutionCache() {
  *
  * Non-static (and re-declared) in src/test/txvalidationcache_tests.cpp
  */
-bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
     if (tx.IsCoinBase()) return true;
 
@@ -1542,8 +1749,7 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     uint256 hashCacheEntry;
     CSHA256 hasher = g_scriptExecutionCacheHasher;
     hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-    AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
-    if (g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+    if (WITH_LOCK(g_script_execution_cache_mutex, return g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore))) {
         return true;
     }
 
@@ -1595,9 +1801,15 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
         }
     }
 
+    if (cacheSigStore && !pvChecks) {
+        // Make the signatures we verified available to other threads.
+        FlushSignatureCache();
+    }
+
     if (cacheFullScriptStore && !pvChecks) {
         // We executed all of the provided scripts, and were told to
         // cache the result. Do so now.
+        LOCK(g_script_execution_cache_mutex);
         g_scriptExecutionCache.insert(hashCacheEntry);
     }
 
@@ -2389,8 +2601,11 @@ bool CChainState::FlushStateToDisk(
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
         if (fDoFullFlush && !CoinsTip().GetBestBlock().IsNull()) {
-            LOG_TIME_SECONDS(strprintf("write coins cache to disk (%d coins, %.2fkB)",
-                coins_count, coins_mem_usage / 1000));
+            // Keep part of the cache so that block connection doesn't have
+            // to fetch it all from disk again.
+            const size_t retain_bytes = m_coinstip_cache_size_bytes / 100 * g_dbcache_retain;
+            LOG_TIME_SECONDS(strprintf("write coins cache to disk (%d coins, %.2fkB, keeping up to %.2fkB)",
+                coins_count, coins_mem_usage / 1000, retain_bytes / 1000));
 
             // Typical Coin structures on disk are around 48 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -2401,10 +2616,31 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Disk space is too low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            const int64_t flush_start = GetTimeMicros();
+            if (!(retain_bytes > 0 ? CoinsTip().PartialFlush(retain_bytes) : CoinsTip().Flush()))
+                return AbortNode(state, "Failed to write to coin database");
+            // The coins are written in the background, unless the caller is
+            // about to read the database directly or shut down, or we are
+            // deleting block files the database might still need.
+            if ((mode == FlushStateMode::ALWAYS || fFlushForPrune) && !CoinsWriter().Sync())
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
+
+            CoinsFlushStats& stats = m_last_coins_flush;
+            const uint64_t hits_total = CoinsTip().GetCacheHits();
+            const uint64_t misses_total = CoinsTip().GetCacheMisses();
+            stats.hits = hits_total - std::min(stats.hits_total, hits_total);
+            stats.misses = misses_total - std::min(stats.misses_total, misses_total);
+            stats.hits_total = hits_total;
+            stats.misses_total = misses_total;
+            stats.time = GetTime();
+            stats.duration = GetTimeMicros() - flush_start;
+            stats.partial = retain_bytes > 0;
+            stats.coins_before = coins_count;
+            stats.coins_after = CoinsTip().GetCacheSize();
+            stats.usage_before = coins_mem_usage;
+            stats.usage_after = CoinsTip().DynamicMemoryUsage();
         }
     }
     if (full_flush_completed) {
@@ -2622,10 +2858,14 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
+        // Use the copy read ahead by the block prefetcher, if there is one.
+        if (m_block_prefetcher) pthisBlock = m_block_prefetcher->Take(pindexNew->GetBlockHash());
+        if (!pthisBlock) {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pthisBlock = pblockNew;
+        }
     } else {
         pthisBlock = pblock;
     }
@@ -2671,6 +2911,42 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     return true;
 }
 
+void CChainState::ScheduleBlockPrefetch(const CChainParams& chainparams, const std::vector<CBlockIndex*>& to_connect)
+{
+    AssertLockHeld(cs_main);
+    if (g_connect_pipeline_depth == 0) {
+        m_block_prefetcher.reset();
+        return;
+    }
+    if (to_connect.empty()) {
+        if (m_block_prefetcher) m_block_prefetcher->Schedule({});
+        return;
+    }
+    if (!m_block_prefetcher || m_block_prefetcher->Depth() != g_connect_pipeline_depth) {
+        const Consensus::Params& consensus_params = chainparams.GetConsensus();
+        CCoinsViewPrefetch* coins_prefetch = &CoinsPrefetch();
+        m_block_prefetcher = MakeUnique<BlockPrefetcher>(
+            [&consensus_params](CBlock& block, const FlatFilePos& pos) {
+                return ReadBlockFromDisk(block, pos, consensus_params);
+            },
+            [coins_prefetch](const CBlock& block) {
+                // Stage the inputs while the blocks before this one are being
+                // connected. Outputs created by those blocks simply miss.
+                coins_prefetch->PrefetchInputs(block);
+            },
+            g_connect_pipeline_depth);
+    }
+
+    std::vector<std::pair<uint256, FlatFilePos>> blocks;
+    blocks.reserve(std::min<size_t>(to_connect.size(), g_connect_pipeline_depth));
+    for (const CBlockIndex* pindex : to_connect) {
+        if (blocks.size() >= g_connect_pipeline_depth) break;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) break;
+        blocks.emplace_back(pindex->GetBlockHash(), pindex->GetBlockPos());
+    }
+    m_block_prefetcher->Schedule(blocks);
+}
+
 /**
  * Return the tip of the chain with the most work in it, that isn't
  * known to be invalid (it's however far from certain to be valid).
@@ -2791,6 +3067,16 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         }
         nHeight = nTargetHeight;
 
+        // Keep reading ahead of the blocks being connected. As only one block
+        // is usually connected per call, the schedule is refreshed every time
+        // and blocks read during an earlier call are picked up by ConnectTip.
+        std::vector<CBlockIndex*> to_prefetch;
+        for (CBlockIndex* pindex : reverse_iterate(vpindexToConnect)) {
+            if (pindex == pindexMostWork && pblock) break;
+            to_prefetch.push_back(pindex);
+        }
+        ScheduleBlockPrefetch(chainparams, to_prefetch);
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
@@ -3197,12 +3483,13 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = NewBlockIndex();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
+    BlockMap::iterator mi = m_block_index.emplace(hash, pindexNew).first;
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = m_block_index.find(block.hashPrevBlock);
     if (miPrev != m_block_index.end())
@@ -3906,6 +4193,12 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
         // belt-and-suspenders.
         bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
+        if (ret && ::ChainActive().Tip() && pblock->hashPrevBlock == ::ChainActive().Tip()->GetBlockHash()) {
+            // This block is next in line to be connected: start looking up
+            // its inputs while it is being stored.
+            CChainState& chainstate = ::ChainstateActive();
+            chainstate.CoinsPrefetch().PrefetchInputs(*pblock, &chainstate.CoinsTip());
+        }
         if (ret) {
             // Store to disk
             ret = ::ChainstateActive().AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock);
@@ -4139,6 +4432,23 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos)
     return BlockFileSeq().FileName(pos);
 }
 
+/** Location of the block index snapshot, next to the block index database */
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+CBlockIndex* BlockManager::NewBlockIndex()
+{
+    AssertLockHeld(cs_main);
+
+    if (m_last_chunk_used == BLOCK_INDEX_CHUNK_SIZE) {
+        m_block_index_chunks.emplace_back(new CBlockIndex[BLOCK_INDEX_CHUNK_SIZE]);
+        m_last_chunk_used = 0;
+    }
+    return &m_block_index_chunks.back()[m_last_chunk_used++];
+}
+
 CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -4152,8 +4462,8 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
+    CBlockIndex* pindexNew = NewBlockIndex();
+    mi = m_block_index.emplace(hash, pindexNew).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
@@ -4164,18 +4474,36 @@ bool BlockManager::LoadBlockIndex(
     CBlockTreeDB& blocktree,
     std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    int64_t nTime0 = GetTimeMicros();
+    const auto insert_block_index = [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); };
+    const bool from_snapshot = g_block_index_snapshot && blocktree.LoadBlockIndexSnapshot(GetBlockIndexSnapshotPath(), consensus_params, insert_block_index);
+    if (!from_snapshot && !blocktree.LoadBlockIndexGuts(consensus_params, insert_block_index))
         return false;
+    int64_t nTime1 = GetTimeMicros();
+    LogPrint(BCLog::BENCH, "  - Load %u block index entries from %s: %.2fms\n", m_block_index.size(), from_snapshot ? "snapshot" : "database", MILLI * (nTime1 - nTime0));
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(m_block_index.size());
+    // Calculate nChainWork. Every entry's parent is one height below it, so
+    // heights are dense and the entries can be bucketed rather than sorted.
+    std::vector<size_t> height_start(m_block_index.size() + 1);
+    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
+    {
+        const int height = item.second->nHeight;
+        if (height < 0 || size_t(height) >= m_block_index.size()) {
+            return error("%s: block index entry %s has out of range height %d", __func__, item.first.ToString(), height);
+        }
+        ++height_start[height + 1];
+    }
+    for (size_t height = 1; height < height_start.size(); ++height) {
+        height_start[height] += height_start[height - 1];
+    }
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight(m_block_index.size());
     for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
     {
         CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        vSortedByHeight[height_start[pindex->nHeight]++] = std::make_pair(pindex->nHeight, pindex);
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint(BCLog::BENCH, "  - Order block index by height: %.2fms\n", MILLI * (nTime2 - nTime1));
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         if (ShutdownRequested()) return false;
@@ -4210,6 +4538,9 @@ bool BlockManager::LoadBlockIndex(
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    int64_t nTime3 = GetTimeMicros();
+    LogPrint(BCLog::BENCH, "  - Link block index and build skip pointers: %.2fms\n", MILLI * (nTime3 - nTime2));
+    LogPrint(BCLog::BENCH, "- Load block index: %.2fms\n", MILLI * (nTime3 - nTime0));
 
     return true;
 }
@@ -4218,11 +4549,9 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_chunks.clear();
+    m_last_chunk_used = BLOCK_INDEX_CHUNK_SIZE;
 }
 
 bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -4283,7 +4612,7 @@ bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& ch
 void CChainState::LoadMempool(const ArgsManager& args)
 {
     if (args.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        ::LoadMempool(m_mempool);
+        ::LoadMempool(m_mempool, args.GetBoolArg("-persistmempooltrusted", DEFAULT_PERSIST_MEMPOOL_TRUSTED));
     }
     m_mempool.SetIsLoaded(!ShutdownRequested());
 }
@@ -5051,6 +5380,11 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    if (m_block_prefetcher) m_block_prefetcher->Drain();
+    CoinsPrefetch().Drain();
+    if (!CoinsWriter().Sync()) {
+        return AbortNode("Failed to write to coin database");
+    }
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n",
@@ -5067,9 +5401,9 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
         // Likely no need to flush if cache sizes have grown.
         ret = FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED);
     } else {
-        // Otherwise, flush state to disk and deallocate the in-memory coins map.
+        // Otherwise, flush state to disk, which evicts coins down to the new
+        // size and releases the memory they took.
         ret = FlushStateToDisk(chainparams, state, FlushStateMode::ALWAYS);
-        CoinsTip().ReallocateCache();
     }
     return ret;
 }
@@ -5104,9 +5438,16 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * Version 1 of mempool.dat stores every transaction with its entry time and
+ * fee delta. Version 2 also records the chain tip the mempool was dumped at,
+ * and the fee and sigop cost of every transaction, which is enough to add
+ * them back without checking their scripts as long as the tip is the same.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_TIP = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
 
-bool LoadMempool(CTxMemPool& pool)
+bool LoadMempool(CTxMemPool& pool, bool trusted)
 {
     const CChainParams& chainparams = Params();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
@@ -5127,18 +5468,32 @@ bool LoadMempool(CTxMemPool& pool)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION_NO_TIP && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        uint256 dump_tip;
+        if (version == MEMPOOL_DUMP_VERSION) {
+            file >> dump_tip;
+        }
+        trusted = trusted && !dump_tip.IsNull();
+        if (trusted) {
+            LogPrintf("Skipping script checks for mempool transactions while the tip is still %s\n", dump_tip.ToString());
+        }
         uint64_t num;
         file >> num;
         while (num--) {
             CTransactionRef tx;
             int64_t nTime;
             int64_t nFeeDelta;
+            int64_t nFee = 0;
+            int64_t sigop_cost = 0;
             file >> tx;
             file >> nTime;
             file >> nFeeDelta;
+            if (version == MEMPOOL_DUMP_VERSION) {
+                file >> nFee;
+                file >> sigop_cost;
+            }
 
             CAmount amountdelta = nFeeDelta;
             if (amountdelta) {
@@ -5147,9 +5502,15 @@ bool LoadMempool(CTxMemPool& pool)
             TxValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
+                // Blocks may be connected while the mempool is loading, after
+                // which the recorded state no longer applies.
+                if (trusted && ::ChainActive().Tip()->GetBlockHash() == dump_tip) {
+                    AcceptTrustedToMemoryPool(chainparams, pool, state, tx, nTime, nFee, sigop_cost);
+                } else {
+                    AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
+                                               nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                                               false /* test_accept */);
+                }
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -5209,12 +5570,15 @@ bool DumpMempool(const CTxMemPool& pool)
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
     std::map<uint256, uint256> unbroadcast_txids;
+    uint256 tip;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
-        LOCK(pool.cs);
+        // The mempool is only consistent with the tip while both are locked
+        LOCK2(cs_main, pool.cs);
+        if (::ChainActive().Tip()) tip = ::ChainActive().Tip()->GetBlockHash();
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
@@ -5234,12 +5598,15 @@ bool DumpMempool(const CTxMemPool& pool)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << tip;
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
             file << *(i.tx);
             file << int64_t{count_seconds(i.m_time)};
             file << int64_t{i.nFeeDelta};
+            file << int64_t{i.fee};
+            file << int64_t{i.sigop_cost};
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -5261,6 +5628,116 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 1;
+
+bool LoadScriptCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "scriptcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open script caches file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce;
+    std::vector<uint256> sig_entries;
+    uint256 script_nonce;
+    std::vector<uint256> script_entries;
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        unsigned char magic[CMessageHeader::MESSAGE_START_SIZE];
+        uint64_t version;
+        verifier >> magic;
+        verifier >> version;
+        if (memcmp(magic, Params().MessageStart(), sizeof(magic)) || version != SCRIPT_CACHES_DUMP_VERSION) {
+            return false;
+        }
+        verifier >> sig_nonce >> sig_entries >> script_nonce >> script_entries;
+        uint256 checksum;
+        file >> checksum;
+        if (checksum != verifier.GetHash()) {
+            LogPrintf("Script caches file on disk is corrupted. Continuing anyway.\n");
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize script caches on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    SetSignatureCacheContents(sig_nonce, sig_entries);
+    {
+        LOCK(g_script_execution_cache_mutex);
+        SetScriptExecutionCacheNonce(script_nonce);
+        for (const uint256& entry : script_entries) {
+            g_scriptExecutionCache.insert(entry);
+        }
+    }
+    LogPrintf("Imported script caches from disk: %u signatures, %u script executions\n", sig_entries.size(), script_entries.size());
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce;
+    std::vector<uint256> sig_entries;
+    GetSignatureCacheContents(sig_nonce, sig_entries);
+    uint256 script_nonce;
+    std::vector<uint256> script_entries;
+    {
+        LOCK(g_script_execution_cache_mutex);
+        script_nonce = g_scriptExecutionCacheNonce;
+        g_scriptExecutionCache.for_each([&script_entries](const uint256& entry) { script_entries.push_back(entry); });
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "scriptcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        file << Params().MessageStart() << SCRIPT_CACHES_DUMP_VERSION << sig_nonce << sig_entries << script_nonce << script_entries;
+        hasher << Params().MessageStart() << SCRIPT_CACHES_DUMP_VERSION << sig_nonce << sig_entries << script_nonce << script_entries;
+        file << hasher.GetHash();
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "scriptcache.dat.new", GetDataDir() / "scriptcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped script caches: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump script caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool DumpBlockIndexSnapshot(ChainstateManager& chainman)
+{
+    AssertLockHeld(cs_main);
+    if (!setDirtyBlockIndex.empty()) {
+        return error("%s: block index has not been flushed", __func__);
+    }
+
+    int64_t start = GetTimeMicros();
+    std::vector<const CBlockIndex*> entries;
+    entries.reserve(chainman.BlockIndex().size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : chainman.BlockIndex()) {
+        entries.push_back(item.second);
+    }
+    if (!pblocktree->WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), entries)) {
+        return false;
+    }
+    LogPrintf("Dumped block index snapshot: %u entries, %gs\n", entries.size(), (GetTimeMicros() - start) * MICRO);
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -5280,20 +5757,6 @@ double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pin
     return std::min<double>(pindex->nChainTx / fTxTotal, 1.0);
 }
 
-class CMainCleanup
-{
-public:
-    CMainCleanup() {}
-    ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = g_chainman.BlockIndex().begin();
-        for (; it1 != g_chainman.BlockIndex().end(); it1++)
-            delete (*it1).second;
-        g_chainman.BlockIndex().clear();
-    }
-};
-static CMainCleanup instance_of_cmaincleanup;
-
 Optional<uint256> ChainstateManager::SnapshotBlockhash() const {
     if (m_active_chainstate != nullptr) {
         // If a snapshot chainstate exists, it will always be our active.
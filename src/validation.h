@@ -11,8 +11,10 @@
 #endif
 
 #include <amount.h>
+#include <blockprefetch.h>
 #include <coins.h>
 #include <crypto/common.h> // for ReadLE64
+#include <flatmap.h>
 #include <fs.h>
 #include <optional.h>
 #include <policy/feerate.h>
@@ -51,6 +53,7 @@ struct ChainTxData;
 struct DisconnectedBlockTransactions;
 struct PrecomputedTransactionData;
 struct LockPoints;
+class SignatureBatch;
 
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 1000;
@@ -67,19 +70,31 @@ static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** Maximum number of dedicated script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 15;
+static const int MAX_SCRIPTCHECK_THREADS = 63;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
+/** Default for -batchsigchecks */
+static const bool DEFAULT_BATCH_SIGNATURE_CHECKS = false;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistmempooltrusted */
+static const bool DEFAULT_PERSIST_MEMPOOL_TRUSTED = false;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIG_CACHE = false;
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCK_INDEX_SNAPSHOT = false;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
+/** Default for -dbcacheretain, percentage of the coins cache kept across flushes that are not forced */
+static const int DEFAULT_DBCACHE_RETAIN = 50;
+/** Maximum for -dbcacheretain, leaving room before the cache counts as large again */
+static const int MAX_DBCACHE_RETAIN = 80;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ::ChainActive().Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 static const signed int DEFAULT_CHECKBLOCKS = 6;
@@ -113,7 +128,7 @@ enum class SynchronizationState {
 
 extern RecursiveMutex cs_main;
 extern CBlockPolicyEstimator feeEstimator;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef flatmap<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern Mutex g_best_block_mutex;
 extern std::condition_variable g_best_block_cv;
 extern uint256 g_best_block;
@@ -123,6 +138,16 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Number of blocks read ahead of the tip while connecting (see -connectpipelinedepth), 0 to disable. */
+extern unsigned int g_connect_pipeline_depth;
+/** Number of threads staging block inputs ahead of ConnectBlock (see -utxoprefetchthreads), 0 to disable. */
+extern int g_utxo_prefetch_threads;
+/** Percentage of -dbcache to keep cached when flushing the coins cache (see -dbcacheretain), 0 to empty it. */
+extern int g_dbcache_retain;
+/** Whether the block index is saved to and loaded from a snapshot file (see -blockindexsnapshot). */
+extern bool g_block_index_snapshot;
+/** Whether script-checking threads verify the signatures of a batch of checks together (see -batchsigchecks). */
+extern bool g_batch_signature_checks;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -204,6 +229,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add transaction to memory pool like AcceptToMemoryPool, but
+ * without holding cs_main while its scripts are verified, so that several
+ * threads can accept transactions at once. Never bypasses the mempool limits. **/
+bool AcceptToMemoryPoolConcurrent(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
+                        std::list<CTransactionRef>* plTxnReplaced,
+                        const CAmount nAbsurdFee, bool test_accept=false) LOCKS_EXCLUDED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -268,6 +300,13 @@ public:
 
     bool operator()();
 
+    /**
+     * Run the check with signature verification deferred to batch: signatures
+     * not in the signature cache are taken to be valid and added to batch.
+     * The result only holds if batch later finds all of them valid.
+     */
+    bool RunDeferred(SignatureBatch& batch);
+
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
         std::swap(m_tx_out, check.m_tx_out);
@@ -281,6 +320,14 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Run a batch of script checks taken off the script check queue. With
+ * -batchsigchecks, the signatures of the whole batch are verified together
+ * after all of its scripts have run, and only the checks that relied on an
+ * invalid signature are run again on their own.
+ */
+bool RunCheckBatch(std::vector<CScriptCheck>& checks);
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -344,11 +391,34 @@ enum class FlushStateMode {
     ALWAYS
 };
 
+/** What the most recent write of the coins cache to disk did. */
+struct CoinsFlushStats {
+    //! Time the flush finished, 0 if there was none yet
+    int64_t time{0};
+    //! Time the flush held up block connection, in microseconds
+    int64_t duration{0};
+    //! Whether coins were kept in the cache (see -dbcacheretain)
+    bool partial{false};
+    size_t coins_before{0};
+    size_t coins_after{0};
+    size_t usage_before{0};
+    size_t usage_after{0};
+    //! Cache hits and misses between the previous flush and this one
+    uint64_t hits{0};
+    uint64_t misses{0};
+    //! Hit and miss counters of the coins cache when the flush finished
+    uint64_t hits_total{0};
+    uint64_t misses_total{0};
+};
+
 struct CBlockIndexWorkComparator
 {
     bool operator()(const CBlockIndex *pa, const CBlockIndex *pb) const;
 };
 
+/** Number of CBlockIndex entries BlockManager allocates at once */
+static const size_t BLOCK_INDEX_CHUNK_SIZE = 4096;
+
 /**
  * Maintains a tree of blocks (stored in `m_block_index`) which is consulted
  * to determine where the most-work tip is.
@@ -357,6 +427,20 @@ struct CBlockIndexWorkComparator
  * candidate tips is not maintained here.
  */
 class BlockManager {
+private:
+    /**
+     * Storage for the entries of m_block_index. They are allocated in chunks
+     * rather than one by one, which saves the per-allocation overhead and
+     * keeps blocks inserted in a row (as during header sync and loading)
+     * next to each other. Entries are never freed before Unload().
+     */
+    std::vector<std::unique_ptr<CBlockIndex[]>> m_block_index_chunks GUARDED_BY(cs_main);
+    //! Number of entries handed out from the last chunk.
+    size_t m_last_chunk_used GUARDED_BY(cs_main){BLOCK_INDEX_CHUNK_SIZE};
+
+    //! Allocate a default-constructed entry for m_block_index.
+    CBlockIndex* NewBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -434,6 +518,13 @@ public:
     //! All unspent coins reside in this store.
     CCoinsViewDB m_dbview GUARDED_BY(cs_main);
 
+    //! This view stages coins looked up ahead of time by background threads.
+    CCoinsViewPrefetch m_prefetchview;
+
+    //! This view writes to leveldb on a background thread, so that flushes
+    //! of the cache don't stall block connection.
+    CCoinsViewAsyncWriter m_writerview;
+
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
@@ -516,6 +607,11 @@ private:
     //! Manages the UTXO set, which is a reflection of the contents of `m_chain`.
     std::unique_ptr<CoinsViews> m_coins_views;
 
+    //! Reads blocks ahead of the tip while connecting, created on first use
+    //! when g_connect_pipeline_depth is non-zero. Its warm callback reads from
+    //! `m_coins_views`, so it must be drained or reset before those change.
+    std::unique_ptr<BlockPrefetcher> m_block_prefetcher;
+
 public:
     explicit CChainState(CTxMemPool& mempool, BlockManager& blockman, uint256 from_snapshot_blockhash = uint256());
 
@@ -572,6 +668,18 @@ public:
         return m_coins_views->m_dbview;
     }
 
+    //! @returns A reference to the view staging prefetched coins in front of the database.
+    CCoinsViewPrefetch& CoinsPrefetch()
+    {
+        return m_coins_views->m_prefetchview;
+    }
+
+    //! @returns A reference to the view writing the UTXO set to disk in the background.
+    CCoinsViewAsyncWriter& CoinsWriter()
+    {
+        return m_coins_views->m_writerview;
+    }
+
     //! @returns A reference to a wrapped view of the in-memory UTXO set that
     //!     handles disk read errors gracefully.
     CCoinsViewErrorCatcher& CoinsErrorCatcher() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -580,7 +688,7 @@ public:
     }
 
     //! Destructs all objects related to accessing the UTXO set.
-    void ResetCoinsViews() { m_coins_views.reset(); }
+    void ResetCoinsViews() { m_block_prefetcher.reset(); m_coins_views.reset(); }
 
     //! The cache size of the on-disk coins view.
     size_t m_coinsdb_cache_size_bytes{0};
@@ -588,6 +696,9 @@ public:
     //! The cache size of the in-memory coins view.
     size_t m_coinstip_cache_size_bytes{0};
 
+    //! Statistics about the last write of the coins cache to disk.
+    CoinsFlushStats m_last_coins_flush GUARDED_BY(::cs_main);
+
     //! Resize the CoinsViews caches dynamically and flush state to disk.
     //! @returns true unless an error occurred during the flush.
     bool ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
@@ -692,6 +803,8 @@ public:
 private:
     bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
+    /** Hand the blocks about to be connected (in connection order) to the block prefetcher. */
+    void ScheduleBlockPrefetch(const CChainParams& chainparams, const std::vector<CBlockIndex*>& to_connect) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     void InvalidBlockFound(CBlockIndex *pindex, const BlockValidationState &state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     CBlockIndex* FindMostWorkChain() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -948,8 +1061,21 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 bool DumpMempool(const CTxMemPool& pool);
 
-/** Load the mempool from disk. */
-bool LoadMempool(CTxMemPool& pool);
+/** Write the block index to its snapshot file. The block index must have been flushed. */
+bool DumpBlockIndexSnapshot(ChainstateManager& chainman) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/** Dump the signature and script execution caches to disk, with the nonces their entries are salted with. */
+bool DumpScriptCaches();
+
+/** Load the signature and script execution caches from disk. Must be called before any script is checked. */
+bool LoadScriptCaches();
+
+/**
+ * Load the mempool from disk. If trusted is set, transactions from a file
+ * written at the current chain tip are added without checking their scripts
+ * again.
+ */
+bool LoadMempool(CTxMemPool& pool, bool trusted = false);
 
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
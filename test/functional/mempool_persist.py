@@ -28,6 +28,9 @@ Test is as follows:
   - Restart node0 with -persistmempool. Verify that it has 5
     transactions in its mempool. This tests that -persistmempool=0
     does not overwrite a previously valid mempool stored on disk.
+  - Restart node0 with -persistmempooltrusted. Verify that it loads
+    the same transactions without checking their scripts, as the tip
+    has not changed since they were saved.
   - Remove node0 mempool.dat and verify savemempool RPC recreates it
     and verify that node1 can load it and has 5 transactions in its
     mempool.
@@ -127,6 +130,14 @@ class MempoolPersistTest(BaddcoinTestFramework):
         assert self.nodes[0].getmempoolinfo()["loaded"]
         assert_equal(len(self.nodes[0].getrawmempool()), 6)
 
+        self.log.debug("Stop-start node0 with -persistmempooltrusted. Verify that it loads the transactions without checking their scripts.")
+        self.stop_nodes()
+        with self.nodes[0].assert_debug_log(["Skipping script checks for mempool transactions"]):
+            self.start_node(0, extra_args=["-persistmempooltrusted"])
+        assert self.nodes[0].getmempoolinfo()["loaded"]
+        assert_equal(len(self.nodes[0].getrawmempool()), 6)
+        assert_equal(tx_creation_time, self.nodes[0].getmempoolentry(txid=last_txid)['time'])
+
         mempooldat0 = os.path.join(self.nodes[0].datadir, self.chain, 'mempool.dat')
         mempooldat1 = os.path.join(self.nodes[1].datadir, self.chain, 'mempool.dat')
         self.log.debug("Remove the mempool.dat file. Verify that savemempool to disk via RPC re-creates it")
@@ -85,6 +85,14 @@ class MiningTest(BaddcoinTestFramework):
         assert 'proposal' in tmpl['capabilities']
         assert 'coinbasetxn' not in tmpl
 
+        self.log.info("getblocktemplate: Test delta since an earlier template")
+        assert 'removed' not in tmpl
+        delta = node.getblocktemplate({'rules': ['segwit'], 'since': tmpl['templateid']})
+        assert_equal(delta['removed'], [])
+        assert_equal(delta['transactions'], [])
+        assert_equal(delta['templateid'], tmpl['templateid'])
+        assert_raises_rpc_error(-8, "Invalid since", node.getblocktemplate, {'rules': ['segwit'], 'since': 'xx'})
+
         next_height = int(tmpl["height"])
         coinbase_tx = create_coinbase(height=next_height)
         # sequence numbers must not be max for nLockTime to have effect
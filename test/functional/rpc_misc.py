@@ -54,6 +54,13 @@ class RpcMiscTest(BaddcoinTestFramework):
 
         assert_raises_rpc_error(-8, "unknown mode foobar", node.getmemoryinfo, mode="foobar")
 
+        self.log.info("test getsignaturecacheinfo")
+        sigcache = node.getsignaturecacheinfo()
+        assert_greater_than(sigcache['shards'], 0)
+        assert_greater_than_or_equal(sigcache['capacity'], sigcache['shards'])
+        for counter in ['hits', 'misses', 'inserts', 'evictions']:
+            assert_greater_than_or_equal(sigcache[counter], 0)
+
         self.log.info("test logging")
         assert_equal(node.logging()['qt'], True)
         node.logging(exclude=['qt'])
@@ -174,6 +174,10 @@ class NetTest(BaddcoinTestFramework):
         # check the `servicesnames` field
         for info in peer_info:
             assert_net_servicesnames(int(info[0]["services"], 0x10), info[0]["servicesnames"])
+        # check the transaction validation queue counters
+        for info in peer_info:
+            assert_equal(info[0]['tx_queued'], 0)
+            assert info[0]['tx_processed'] >= 0
 
     def test_service_flags(self):
         self.log.info("Test service flags")